@@ -0,0 +1,162 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "binary_protocol.h"
+
+static int failures = 0;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+/* Append a record to frame at *length */
+static void putRecord(uint8_t *frame, size_t *length, uint8_t opcode, uint8_t arg, int16_t x, int16_t y,
+                      uint8_t speed, uint16_t sequence) {
+    uint8_t *record = frame + *length;
+    record[0] = opcode;
+    record[1] = arg;
+    record[2] = (uint8_t) x;
+    record[3] = (uint8_t) ((uint16_t) x >> 8);
+    record[4] = (uint8_t) y;
+    record[5] = (uint8_t) ((uint16_t) y >> 8);
+    record[6] = speed;
+    record[7] = 0;
+    record[8] = (uint8_t) sequence;
+    record[9] = (uint8_t) (sequence >> 8);
+    *length += BINARY_RECORD_SIZE;
+}
+
+/* A frame of one record, expected to fail to decode at offset 1 */
+static void checkRejected(const char *what, uint8_t opcode, uint8_t arg, int16_t x, uint8_t speed) {
+    uint8_t frame[64] = {BINARY_FRAME_V1};
+    size_t length = 1;
+    putRecord(frame, &length, opcode, arg, x, 0, speed, 42);
+    size_t offset = 0;
+    BinaryCommand command;
+    BinaryDecodeResult result = decodeBinaryCommand(frame, length, &offset, &command);
+    CHECK(result == BINARY_DECODE_ERROR, "%s decoded as %d", what, result);
+    CHECK(offset == 1, "%s left offset at %zu", what, offset);
+    CHECK(binaryRecordSequence(frame, length, offset) == 42, "%s has sequence %u", what,
+          binaryRecordSequence(frame, length, offset));
+}
+
+/* Every opcode in one frame, in order */
+static void testValidFrame() {
+    uint8_t frame[128] = {BINARY_FRAME_V1};
+    size_t length = 1;
+    putRecord(frame, &length, BINARY_OP_HOME, 0, 0, 0, 0, 1);
+    putRecord(frame, &length, BINARY_OP_MOVE, 7, 3, 0, 0, 2);
+    putRecord(frame, &length, BINARY_OP_MAGNET, 1, 0, 0, 0, 3);
+    putRecord(frame, &length, BINARY_OP_GOTO, 0, -128, 8 * 256 + 128, 0, 0xBEEF);
+    putRecord(frame, &length, BINARY_OP_CLOCK, 4, 0, 0, 0, 5);
+    memcpy(frame + length, "w123", 4);
+    length += 4;
+
+    size_t offset = 0;
+    BinaryCommand command;
+    CHECK(decodeBinaryCommand(frame, length, &offset, &command) == BINARY_DECODE_OK, "HOME not decoded");
+    CHECK(command.opcode == BINARY_OP_HOME && command.sequence == 1, "opcode %d sequence %u", command.opcode,
+          command.sequence);
+
+    CHECK(decodeBinaryCommand(frame, length, &offset, &command) == BINARY_DECODE_OK, "MOVE not decoded");
+    CHECK(command.opcode == BINARY_OP_MOVE && command.arg == 7 && command.x == 3 && command.sequence == 2,
+          "opcode %d arg %u x %d sequence %u", command.opcode, command.arg, command.x, command.sequence);
+
+    CHECK(decodeBinaryCommand(frame, length, &offset, &command) == BINARY_DECODE_OK, "MAGNET not decoded");
+    CHECK(command.opcode == BINARY_OP_MAGNET && command.arg == 1, "opcode %d arg %u", command.opcode, command.arg);
+
+    CHECK(decodeBinaryCommand(frame, length, &offset, &command) == BINARY_DECODE_OK, "GOTO not decoded");
+    CHECK(command.opcode == BINARY_OP_GOTO && command.sequence == 0xBEEF, "opcode %d sequence %u", command.opcode,
+          command.sequence);
+    CHECK(binaryFixedToDouble(command.x) == -0.5 && binaryFixedToDouble(command.y) == 8.5, "GOTO %f:%f",
+          binaryFixedToDouble(command.x), binaryFixedToDouble(command.y));
+
+    CHECK(decodeBinaryCommand(frame, length, &offset, &command) == BINARY_DECODE_OK, "CLOCK not decoded");
+    CHECK(command.opcode == BINARY_OP_CLOCK && command.arg == 4 && memcmp(command.payload, "w123", 4) == 0,
+          "opcode %d arg %u", command.opcode, command.arg);
+
+    CHECK(decodeBinaryCommand(frame, length, &offset, &command) == BINARY_DECODE_END, "no end after the last record");
+    CHECK(offset == length, "offset %zu at the end of %zu bytes", offset, length);
+}
+
+static void testMalformedRecords() {
+    checkRejected("unknown opcode", 0x7F, 0, 0, 0);
+    checkRejected("MOVE direction 8", BINARY_OP_MOVE, 8, 1, 0);
+    checkRejected("MOVE backwards", BINARY_OP_MOVE, 0, -1, 0);
+    checkRejected("MAGNET 2", BINARY_OP_MAGNET, 2, 0, 0);
+    checkRejected("CLOCK too long", BINARY_OP_CLOCK, BINARY_CLOCK_MAX_LENGTH + 1, 0, 0);
+    checkRejected("CLOCK past the frame", BINARY_OP_CLOCK, 4, 0, 0);
+    checkRejected("speed", BINARY_OP_HOME, 0, 0, 1);
+}
+
+static void testBadVersion() {
+    const uint8_t text[] = "N3";
+    size_t offset = 0;
+    BinaryCommand command;
+    CHECK(decodeBinaryCommand(text, 2, &offset, &command) == BINARY_DECODE_ERROR, "text decoded as binary");
+    CHECK(decodeBinaryCommand(text, 0, &offset, &command) == BINARY_DECODE_ERROR, "empty frame decoded");
+    CHECK(offset == 0, "offset %zu after a bad version", offset);
+    CHECK(binaryRecordSequence(text, 2, offset) == 0, "sequence read from the version byte");
+    CHECK(!isBinaryFrame(text, 2), "text taken for a binary frame");
+    CHECK(isBinaryFrame((const uint8_t[]) {BINARY_FRAME_V1}, 1), "version byte not taken for a binary frame");
+}
+
+/* Records cut short anywhere are errors, the records before them still decode */
+static void testTruncation() {
+    uint8_t frame[64] = {BINARY_FRAME_V1};
+    size_t full = 1;
+    putRecord(frame, &full, BINARY_OP_HOME, 0, 0, 0, 0, 1);
+    putRecord(frame, &full, BINARY_OP_MAGNET, 1, 0, 0, 0, 2);
+
+    for (size_t cut = 1; cut < BINARY_RECORD_SIZE; cut++) {
+        size_t length = full - cut;
+        size_t offset = 0;
+        BinaryCommand command;
+        CHECK(decodeBinaryCommand(frame, length, &offset, &command) == BINARY_DECODE_OK, "first record lost");
+        BinaryDecodeResult result = decodeBinaryCommand(frame, length, &offset, &command);
+        CHECK(result == BINARY_DECODE_ERROR, "record cut by %zu decoded as %d", cut, result);
+        CHECK(offset == 1 + BINARY_RECORD_SIZE, "offset %zu for a record cut by %zu", offset, cut);
+        CHECK(binaryRecordSequence(frame, length, offset) == 0, "sequence read from a record cut by %zu", cut);
+    }
+}
+
+/* Every 8.8 value survives the trip through the little endian field */
+static void testFixedPoint() {
+    for (int32_t fixed = INT16_MIN; fixed <= INT16_MAX; fixed++) {
+        double tiles = fixed / 256.0;
+        int16_t encoded = (int16_t) lround(tiles * 256);
+        uint8_t frame[16] = {BINARY_FRAME_V1};
+        size_t length = 1;
+        putRecord(frame, &length, BINARY_OP_GOTO, 0, encoded, encoded, 0, 1);
+        size_t offset = 0;
+        BinaryCommand command;
+        decodeBinaryCommand(frame, length, &offset, &command);
+        bool same = binaryFixedToDouble(command.x) == tiles && binaryFixedToDouble(command.y) == tiles;
+        CHECK(same, "%f tiles decoded as %f:%f", tiles, binaryFixedToDouble(command.x), binaryFixedToDouble(command.y));
+        if (!same) {
+            break;
+        }
+    }
+}
+
+int main() {
+    testValidFrame();
+    testMalformedRecords();
+    testBadVersion();
+    testTruncation();
+    testFixedPoint();
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
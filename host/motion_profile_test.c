@@ -0,0 +1,106 @@
+#include <stdio.h>
+
+#include "motion_profile.h"
+
+#define MAX_TEST_STEPS 200000
+
+// As in motion.c
+#define ORTHOGONAL_TILE_IN_STEPS 5860
+#define MAX_LOOP_STEPS 1023
+#define HOMING_MAX_TRAVEL_STEPS (9 * ORTHOGONAL_TILE_IN_STEPS)
+// Corner to corner in one move only runs one motor, for 7 tiles along both axes
+#define FULL_DIAGONAL_STEPS (2 * 7 * ORTHOGONAL_TILE_IN_STEPS)
+
+static int failures = 0;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+/*
+ * The profiled phases must drive exactly the steps the uniform move did, otherwise the head drifts
+ * a little further off with every move.
+ */
+static void testPlanMatchesUniformTotal() {
+    for (int type = 0; type < PROFILE_COUNT; type++) {
+        const MotionProfile *profile = &motionProfiles[type];
+        for (uint32_t total = 0; total <= MAX_TEST_STEPS; total++) {
+            MovePlan plan = planMove(profile, total);
+            CHECK(plan.accelSteps + plan.cruiseSteps + plan.decelSteps == total,
+                  "profile %d, %u steps: %u + %u + %u", type, total, plan.accelSteps, plan.cruiseSteps,
+                  plan.decelSteps);
+            // The ramps are read from curve tables ramp_steps long
+            CHECK(plan.accelSteps <= profile->ramp_steps && plan.decelSteps <= profile->ramp_steps,
+                  "profile %d, %u steps: ramps %u and %u", type, total, plan.accelSteps, plan.decelSteps);
+            CHECK(plan.cruiseSteps == 0 || plan.accelSteps == plan.decelSteps,
+                  "profile %d, %u steps: asymmetric ramps with a cruise", type, total);
+        }
+    }
+}
+
+static void checkChunks(uint32_t total, uint32_t chunks, const char *what) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < chunks; i++) {
+        uint32_t steps = chunkSteps(total, chunks, i);
+        // A chunk is one transaction with its steps as loop count, 0 would still send one step
+        CHECK(steps > 0 && steps <= MAX_LOOP_STEPS, "%s, %u steps: chunk %u of %u has %u steps", what, total, i,
+              chunks, steps);
+        sum += steps;
+    }
+    CHECK(sum == total, "%s, %u steps: chunks add up to %llu", what, total, (unsigned long long) sum);
+}
+
+/*
+ * Uniform phases longer than the loop counter are split into chunks. They must cover the phase
+ * exactly, each fit the counter and none be empty.
+ */
+static void testChunksCoverTotal() {
+    const uint32_t totals[] = {
+            1, MAX_LOOP_STEPS - 1, MAX_LOOP_STEPS, MAX_LOOP_STEPS + 1, 2 * MAX_LOOP_STEPS, 2 * MAX_LOOP_STEPS + 1,
+            ORTHOGONAL_TILE_IN_STEPS, HOMING_MAX_TRAVEL_STEPS, FULL_DIAGONAL_STEPS, UINT16_MAX, MAX_TEST_STEPS,
+    };
+    CHECK(chunkCount(0, MAX_LOOP_STEPS) == 0, "0 steps need %u chunks", chunkCount(0, MAX_LOOP_STEPS));
+    for (size_t i = 0; i < sizeof(totals) / sizeof(totals[0]); i++) {
+        checkChunks(totals[i], chunkCount(totals[i], MAX_LOOP_STEPS), "uniform");
+    }
+    for (uint32_t total = 1; total <= MAX_TEST_STEPS; total++) {
+        checkChunks(total, chunkCount(total, MAX_LOOP_STEPS), "uniform");
+    }
+}
+
+/*
+ * In a synchronised move the slower motor splits its cruise into as many chunks as the faster one,
+ * which transmitProfiledSteps() only does once it has a step for every chunk. Check every slower
+ * cruise that qualifies against the long moves, where the chunk count is highest.
+ */
+static void testSlowCruiseMatchesFastChunks() {
+    const uint32_t fastTotals[] = {HOMING_MAX_TRAVEL_STEPS, FULL_DIAGONAL_STEPS};
+    for (size_t i = 0; i < sizeof(fastTotals) / sizeof(fastTotals[0]); i++) {
+        for (int type = 0; type < PROFILE_COUNT; type++) {
+            MovePlan fast = planMove(&motionProfiles[type], fastTotals[i]);
+            uint32_t chunks = chunkCount(fast.cruiseSteps, MAX_LOOP_STEPS);
+            checkChunks(fast.cruiseSteps, chunks, "fast cruise");
+            for (uint32_t slowCruise = chunks; slowCruise <= fast.cruiseSteps; slowCruise++) {
+                checkChunks(slowCruise, chunks, "slow cruise");
+            }
+        }
+    }
+}
+
+int main() {
+    testPlanMatchesUniformTotal();
+    testChunksCoverTotal();
+    testSlowCruiseMatchesFastChunks();
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
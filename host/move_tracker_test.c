@@ -0,0 +1,223 @@
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "move_tracker.h"
+
+#define SQUARE_BIT(square) (1ULL << (square))
+#define E1 4
+#define F1 5
+#define G1 6
+#define H1 7
+#define A2 8
+#define A3 16
+#define E2 12
+#define D3 19
+#define E4 28
+#define D5 35
+#define E5 36
+#define D6 43
+#define SECOND_US 1000000
+
+static int failures = 0;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static void checkMove(const BoardMove *move, int from, int to, MoveKind kind) {
+    CHECK(move->from == from && move->to == to && move->kind == kind, "got %d-%d kind %d, expected %d-%d kind %d",
+          move->from, move->to, move->kind, from, to, kind);
+}
+
+/*
+ * Feed boards one second apart, expecting no move until the last one, which must complete exactly
+ * one move. Returns it in move.
+ */
+static void play(MoveTracker *tracker, const uint64_t *boards, int count, BoardMove *move) {
+    BoardMove moves[MAX_MOVES_PER_UPDATE];
+    for (int i = 0; i < count; i++) {
+        int completed = moveTrackerUpdate(tracker, boards[i], (int64_t) i * SECOND_US, moves);
+        int expected = i == count - 1 ? 1 : 0;
+        CHECK(completed == expected, "board %d of %d completed %d moves", i + 1, count, completed);
+        if (completed > 0) {
+            *move = moves[0];
+        }
+    }
+}
+
+/* Lift the taken piece, lift the taking one and put it down in its place */
+static void testCapture() {
+    MoveTracker tracker = {0};
+    BoardMove move;
+    moveTrackerReset(&tracker, SQUARE_BIT(E2) | SQUARE_BIT(D3));
+    const uint64_t boards[] = {SQUARE_BIT(E2), 0, SQUARE_BIT(D3)};
+    play(&tracker, boards, 3, &move);
+    checkMove(&move, E2, D3, MOVE_CAPTURE);
+    CHECK(move.captured == D3 && !move.corrects, "captured %d corrects %d", move.captured, move.corrects);
+}
+
+/* The taken pawn off the board first, then the taking pawn moved */
+static void testEnPassantTakenFirst() {
+    MoveTracker tracker = {0};
+    BoardMove move;
+    moveTrackerReset(&tracker, SQUARE_BIT(E5) | SQUARE_BIT(D5));
+    const uint64_t boards[] = {SQUARE_BIT(E5), 0, SQUARE_BIT(D6)};
+    play(&tracker, boards, 3, &move);
+    checkMove(&move, E5, D6, MOVE_EN_PASSANT);
+    CHECK(move.captured == D5 && !move.corrects, "captured %d corrects %d", move.captured, move.corrects);
+}
+
+/* The taking pawn moved first looks like a normal move until the taken pawn is lifted */
+static void testEnPassantTakenLast() {
+    MoveTracker tracker = {0};
+    BoardMove move;
+    moveTrackerReset(&tracker, SQUARE_BIT(E5) | SQUARE_BIT(D5) | SQUARE_BIT(A2));
+    const uint64_t first[] = {SQUARE_BIT(D5) | SQUARE_BIT(A2), SQUARE_BIT(D5) | SQUARE_BIT(D6) | SQUARE_BIT(A2)};
+    play(&tracker, first, 2, &move);
+    checkMove(&move, E5, D6, MOVE_NORMAL);
+
+    const uint64_t last[] = {SQUARE_BIT(D6) | SQUARE_BIT(A2)};
+    play(&tracker, last, 1, &move);
+    checkMove(&move, E5, D6, MOVE_EN_PASSANT);
+    CHECK(move.captured == D5 && move.corrects, "captured %d corrects %d", move.captured, move.corrects);
+
+    // Tracking carries on
+    const uint64_t next[] = {SQUARE_BIT(D6) | SQUARE_BIT(A3)};
+    play(&tracker, next, 1, &move);
+    checkMove(&move, A2, A3, MOVE_NORMAL);
+}
+
+/* King first, the king move is held back until the rook follows */
+static void testCastlingKingFirst() {
+    MoveTracker tracker = {0};
+    BoardMove moves[MAX_MOVES_PER_UPDATE];
+    moveTrackerReset(&tracker, SQUARE_BIT(E1) | SQUARE_BIT(H1));
+    CHECK(moveTrackerUpdate(&tracker, SQUARE_BIT(H1), 0, moves) == 0, "lifting the king completed a move");
+    CHECK(moveTrackerUpdate(&tracker, SQUARE_BIT(G1) | SQUARE_BIT(H1), SECOND_US, moves) == 0,
+          "the king move was not held");
+    CHECK(moveTrackerUpdate(&tracker, SQUARE_BIT(G1), 2 * SECOND_US, moves) == 0, "lifting the rook completed a move");
+    int count = moveTrackerUpdate(&tracker, SQUARE_BIT(G1) | SQUARE_BIT(F1), 3 * SECOND_US, moves);
+    CHECK(count == 1, "%d moves for castling", count);
+    checkMove(&moves[0], E1, G1, MOVE_CASTLE);
+    CHECK(!moves[0].corrects, "castling king first corrects a move");
+}
+
+/* Rook first, it is reported as a rook move until the king follows */
+static void testCastlingRookFirst() {
+    MoveTracker tracker = {0};
+    BoardMove move;
+    moveTrackerReset(&tracker, SQUARE_BIT(E1) | SQUARE_BIT(H1));
+    const uint64_t rook[] = {SQUARE_BIT(E1), SQUARE_BIT(E1) | SQUARE_BIT(F1)};
+    play(&tracker, rook, 2, &move);
+    checkMove(&move, H1, F1, MOVE_NORMAL);
+
+    const uint64_t king[] = {SQUARE_BIT(F1), SQUARE_BIT(F1) | SQUARE_BIT(G1)};
+    play(&tracker, king, 2, &move);
+    checkMove(&move, E1, G1, MOVE_CASTLE);
+    CHECK(move.corrects, "castling rook first doesn't correct the rook move");
+}
+
+/* A piece knocked off the board matches no move, tracking resumes from the board as it is */
+static void testResyncAfterTimeout() {
+    MoveTracker tracker = {0};
+    BoardMove moves[MAX_MOVES_PER_UPDATE];
+    moveTrackerReset(&tracker, SQUARE_BIT(E2) | SQUARE_BIT(A2) | SQUARE_BIT(H1));
+
+    CHECK(moveTrackerUpdate(&tracker, SQUARE_BIT(A2) | SQUARE_BIT(H1), 0, moves) == 0, "a lone removal completed a move");
+    CHECK(moveTrackerDeadline(&tracker) == MOVE_RESYNC_TIMEOUT_US, "deadline %" PRId64, moveTrackerDeadline(&tracker));
+    CHECK(moveTrackerRelease(&tracker, MOVE_RESYNC_TIMEOUT_US - 1, moves) == 0, "resynced before the timeout");
+    int count = moveTrackerRelease(&tracker, MOVE_RESYNC_TIMEOUT_US, moves);
+    CHECK(count == 1 && moves[0].kind == MOVE_UNKNOWN, "%d moves after the timeout, kind %d", count, moves[0].kind);
+    CHECK(moveTrackerDeadline(&tracker) == -1, "still waiting after the resync");
+
+    count = moveTrackerUpdate(&tracker, SQUARE_BIT(A3) | SQUARE_BIT(H1), MOVE_RESYNC_TIMEOUT_US + SECOND_US, moves);
+    CHECK(count == 1, "%d moves after the resync", count);
+    checkMove(&moves[0], A2, A3, MOVE_NORMAL);
+}
+
+/* A flickering sensor that keeps changing the board resyncs after enough changes */
+static void testResyncAfterUnmatchedUpdates() {
+    MoveTracker tracker = {0};
+    BoardMove moves[MAX_MOVES_PER_UPDATE];
+    uint64_t settled = SQUARE_BIT(E2) | SQUARE_BIT(A2);
+    moveTrackerReset(&tracker, settled);
+
+    const uint64_t flicker[] = {settled | SQUARE_BIT(D5) | SQUARE_BIT(D6), settled | SQUARE_BIT(D5)};
+    int count = 0;
+    int updates = 0;
+    while (count == 0 && updates < 2 * MOVE_RESYNC_UPDATES) {
+        count = moveTrackerUpdate(&tracker, flicker[updates % 2], updates * SECOND_US, moves);
+        updates++;
+    }
+    CHECK(updates == MOVE_RESYNC_UPDATES, "resynced after %d updates", updates);
+    CHECK(count == 1 && moves[0].kind == MOVE_UNKNOWN, "%d moves on resync, kind %d", count, moves[0].kind);
+
+    count = moveTrackerUpdate(&tracker, flicker[(updates - 1) % 2] ^ SQUARE_BIT(E2) ^ SQUARE_BIT(E4),
+                              updates * SECOND_US, moves);
+    CHECK(count == 1, "%d moves after the resync", count);
+    checkMove(&moves[0], E2, E4, MOVE_NORMAL);
+}
+
+/* A king-like move nothing follows is released once it is old enough */
+static void testHeldMoveReleasedAfterTimeout() {
+    MoveTracker tracker = {0};
+    BoardMove moves[MAX_MOVES_PER_UPDATE];
+    BoardMove released[MAX_MOVES_PER_UPDATE];
+    moveTrackerReset(&tracker, SQUARE_BIT(E1) | SQUARE_BIT(H1) | SQUARE_BIT(E2));
+
+    CHECK(moveTrackerUpdate(&tracker, SQUARE_BIT(G1) | SQUARE_BIT(H1) | SQUARE_BIT(E2), 0, moves) == 0,
+          "e1g1 with the rook home was not held");
+    CHECK(moveTrackerDeadline(&tracker) == MOVE_HOLD_TIMEOUT_US, "deadline %" PRId64, moveTrackerDeadline(&tracker));
+    CHECK(moveTrackerRelease(&tracker, MOVE_HOLD_TIMEOUT_US - 1, released) == 0, "released before the timeout");
+    CHECK(moveTrackerRelease(&tracker, MOVE_HOLD_TIMEOUT_US, released) == 1, "not released after the timeout");
+    checkMove(&released[0], E1, G1, MOVE_NORMAL);
+    CHECK(moveTrackerRelease(&tracker, 2 * MOVE_HOLD_TIMEOUT_US, released) == 0, "released twice");
+
+    // The next move is reported on its own
+    int count = moveTrackerUpdate(&tracker, SQUARE_BIT(G1) | SQUARE_BIT(H1) | SQUARE_BIT(E4),
+                                  2 * MOVE_HOLD_TIMEOUT_US, moves);
+    CHECK(count == 1, "%d moves after the release", count);
+    checkMove(&moves[0], E2, E4, MOVE_NORMAL);
+}
+
+/* A rook still in the hand keeps the king move held, so castling is still recognised */
+static void testHeldMoveKeptWhileRookLifted() {
+    MoveTracker tracker = {0};
+    BoardMove moves[MAX_MOVES_PER_UPDATE];
+    BoardMove released[MAX_MOVES_PER_UPDATE];
+    moveTrackerReset(&tracker, SQUARE_BIT(E1) | SQUARE_BIT(H1));
+
+    moveTrackerUpdate(&tracker, SQUARE_BIT(G1) | SQUARE_BIT(H1), 0, moves);
+    CHECK(moveTrackerUpdate(&tracker, SQUARE_BIT(G1), SECOND_US, moves) == 0, "lifting the rook completed a move");
+    CHECK(moveTrackerRelease(&tracker, MOVE_HOLD_TIMEOUT_US + SECOND_US, released) == 0,
+          "released with the rook lifted");
+
+    int count = moveTrackerUpdate(&tracker, SQUARE_BIT(G1) | SQUARE_BIT(F1), MOVE_HOLD_TIMEOUT_US + 2 * SECOND_US,
+                                  moves);
+    CHECK(count == 1, "%d moves for castling", count);
+    checkMove(&moves[0], E1, G1, MOVE_CASTLE);
+}
+
+int main() {
+    testCapture();
+    testEnPassantTakenFirst();
+    testEnPassantTakenLast();
+    testCastlingKingFirst();
+    testCastlingRookFirst();
+    testResyncAfterTimeout();
+    testResyncAfterUnmatchedUpdates();
+    testHeldMoveReleasedAfterTimeout();
+    testHeldMoveKeptWhileRookLifted();
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * Host stand-ins for the ESP-IDF APIs motion.c and stepper_motor_encoder.c use, implemented by the
+ * simulator in host/sim/sim_hw.c. Only what those files need is declared.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+
+const char *esp_err_to_name(esp_err_t code);
+
+/* Aborts the simulation, as the firmware would abort */
+void simCheckFailed(esp_err_t code, const char *expression, const char *file, int line);
+
+#define ESP_ERROR_CHECK(x) \
+    do { \
+        esp_err_t err_rc_ = (x); \
+        if (err_rc_ != ESP_OK) { \
+            simCheckFailed(err_rc_, #x, __FILE__, __LINE__); \
+        } \
+    } while (0)
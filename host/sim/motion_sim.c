@@ -0,0 +1,304 @@
+/*
+ * Plays scripted games through the real motion.c on simulated hardware and reports, per game, how
+ * long the board takes and what it does to the drivers:
+ *
+ *   motion_sim [--verbose] [--trace steps.csv] [--hysteresis steps] game.txt...
+ *
+ * Games hold text commands as sent over BLE or HTTP, separated by commas or newlines, with # starting
+ * a comment. Moves are coalesced as the executor does. Exits non-zero if a command fails, the tracked
+ * position drifts from where the simulated head really is or the RMT driver was misused.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "motion.h"
+#include "sim_hw.h"
+#include "text_script.h"
+
+// Wiring as in motion.c
+#define SIM_STEP1 GPIO_NUM_37
+#define SIM_SLP1 GPIO_NUM_36
+#define SIM_DIR1 GPIO_NUM_38
+#define SIM_RST1 GPIO_NUM_35
+#define SIM_STEP2 GPIO_NUM_47
+#define SIM_SLP2 GPIO_NUM_21
+#define SIM_DIR2 GPIO_NUM_48
+#define SIM_RST2 GPIO_NUM_45
+#define SIM_EM_TOGGLE GPIO_NUM_1
+#define SIM_LIMIT_INNER GPIO_NUM_15
+#define SIM_LIMIT_OUTER GPIO_NUM_16
+
+#define SIM_TILE_STEPS 5860
+// The motors step in turns, so the head stops a step or two either side of where a switch closes
+#define SIM_HOME_TOLERANCE 4
+// The head starts near the middle of the board, x = y = 4 tiles
+#define SIM_START_X (4 * SIM_TILE_STEPS)
+#define SIM_START_Y (4 * SIM_TILE_STEPS)
+
+/* Everything the motion callbacks of one game collect */
+typedef struct {
+    const char *name;
+    int commands;
+    int failed;
+    int64_t firstStartUs;
+    int64_t lastDoneUs;
+    int64_t busyUs;  // Sum of the durations the motion task measured
+    bool pending;  // Move being coalesced
+    Direction dir;
+    double numHalfTiles;
+} Game;
+
+static Game game;
+static bool homed = false;
+static int32_t origin[SIM_MOTOR_COUNT];  // Simulated motor steps where homing left the head
+
+static void onStarted(const MotionResult *result, void *ctx) {
+    if (game.firstStartUs < 0) {
+        game.firstStartUs = esp_timer_get_time();
+    }
+}
+
+static void onDone(const MotionResult *result, void *ctx) {
+    game.lastDoneUs = esp_timer_get_time();
+    game.busyUs += result->durationUs;
+    if (result->type == MOTION_HOME) {
+        int32_t x;
+        int32_t y;
+        homed = motionGetPosition(&x, &y);
+        simGetMotorSteps(origin);
+        // motor1 - motor2 and motor1 + motor2, the switches close where these reach 0
+        int32_t offsetX = origin[0] - origin[1];
+        int32_t offsetY = origin[0] + origin[1];
+        if (!homed) {
+            fprintf(stderr, "%s: homing failed\n", game.name);
+            game.failed++;
+        } else if (abs(offsetX) > SIM_HOME_TOLERANCE || abs(offsetY) > SIM_HOME_TOLERANCE) {
+            fprintf(stderr, "%s: homed %" PRId32 ",%" PRId32 " steps away from where the switches close\n", game.name,
+                    offsetX, offsetY);
+            game.failed++;
+        }
+    }
+    if (result->outcome != MOTION_COMPLETED) {
+        fprintf(stderr, "%s: command %" PRIu32 " (type %d) ended with outcome %d after %d steps\n", game.name,
+                result->id, result->type, result->outcome, result->steps);
+        game.failed++;
+    }
+}
+
+static void flushMove() {
+    if (game.pending) {
+        motionQueueMove(game.dir, game.numHalfTiles, onDone, NULL, portMAX_DELAY);
+        game.pending = false;
+    }
+}
+
+static void onCommand(char *text, void *ctx) {
+    ScriptCommand command;
+    if (!text) {
+        fprintf(stderr, "%s: command longer than %d bytes\n", game.name, TEXT_COMMAND_MAX_LENGTH);
+        game.failed++;
+        return;
+    }
+    if (!parseTextCommand(text, &command)) {
+        fprintf(stderr, "%s: can't parse \"%s\"\n", game.name, text);
+        game.failed++;
+        return;
+    }
+    game.commands++;
+    if (command.type == SCRIPT_MOVE) {
+        if (game.pending && game.dir == command.dir) {
+            game.numHalfTiles += command.numHalfTiles;
+        } else {
+            flushMove();
+            game.pending = true;
+            game.dir = command.dir;
+            game.numHalfTiles = command.numHalfTiles;
+        }
+        return;
+    }
+
+    flushMove();
+    switch (command.type) {
+        case SCRIPT_HOME:
+            motionQueueHome(onDone, NULL, portMAX_DELAY);
+            break;
+        case SCRIPT_MAGNET:
+            motionQueueMagnet(command.magnetOn, onDone, NULL, portMAX_DELAY);
+            break;
+        case SCRIPT_GOTO:
+            motionQueueGoto(command.xTiles, command.yTiles, onDone, NULL, portMAX_DELAY);
+            break;
+        case SCRIPT_CLOCK:
+            // The clock waits for the board's moves, then the human takes their turn
+            motionWaitIdle(portMAX_DELAY);
+            break;
+        case SCRIPT_MOVE:
+        case SCRIPT_END:
+            break;
+    }
+}
+
+/* Feeds the game through the tokenizer line by line, with comments and line breaks removed */
+static bool playGame(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    TextScriptTokenizer tokenizer;
+    textScriptInit(&tokenizer, onCommand, NULL);
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "#\r\n")] = '\0';
+        size_t length = strlen(line);
+        while (length > 0 && (line[length - 1] == ' ' || line[length - 1] == '\t')) {
+            length--;
+        }
+        size_t start = strspn(line, " \t");
+        if (start < length) {
+            textScriptFeed(&tokenizer, line + start, length - start);
+            textScriptFeed(&tokenizer, ",", 1);
+        }
+    }
+    textScriptFinish(&tokenizer);
+    fclose(file);
+    flushMove();
+    simRunTasks();
+    return true;
+}
+
+/* Position error between where motion.c thinks the head is and where it really is, in steps */
+static int32_t positionError(int32_t *errorX, int32_t *errorY) {
+    int32_t x;
+    int32_t y;
+    int32_t steps[SIM_MOTOR_COUNT];
+    if (!homed || !motionGetPosition(&x, &y)) {
+        *errorX = 0;
+        *errorY = 0;
+        return 0;
+    }
+    simGetMotorSteps(steps);
+    int32_t motor1 = steps[0] - origin[0];
+    int32_t motor2 = steps[1] - origin[1];
+    *errorX = x - (motor1 - motor2) / 2;
+    *errorY = y - (motor1 + motor2) / 2;
+    return abs(*errorX) + abs(*errorY);
+}
+
+/* Level changes on a pair of pins since before */
+static uint32_t transitions(const SimStats *before, gpio_num_t first, gpio_num_t second) {
+    const SimStats *now = simGetStats();
+    uint32_t changes = now->transitions[first] - before->transitions[first];
+    if (second != first) {
+        changes += now->transitions[second] - before->transitions[second];
+    }
+    return changes;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: motion_sim [--verbose] [--trace steps.csv] [--hysteresis steps] game.txt...\n");
+}
+
+int main(int argc, char **argv) {
+    bool verbose = false;
+    FILE *trace = NULL;
+    int32_t hysteresis = 0;
+    int first = 1;
+    for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++) {
+        if (strcmp(argv[first], "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[first], "--trace") == 0 && first + 1 < argc) {
+            trace = fopen(argv[++first], "w");
+            if (!trace) {
+                fprintf(stderr, "%s: %s\n", argv[first], strerror(errno));
+                return 1;
+            }
+        } else if (strcmp(argv[first], "--hysteresis") == 0 && first + 1 < argc) {
+            hysteresis = atoi(argv[++first]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (first == argc) {
+        usage();
+        return 1;
+    }
+
+    // The firmware prints a lot to stdout, keep it for --verbose and report on a copy of it
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!verbose) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    } else {
+        simSetLogLevel(ESP_LOG_DEBUG);
+    }
+    simSetTrace(trace);
+
+    simAddMotor(SIM_STEP1, SIM_DIR1, SIM_RST1);
+    simAddMotor(SIM_STEP2, SIM_DIR2, SIM_RST2);
+    // motor1 = x + y and motor2 = y - x
+    const int32_t start[SIM_MOTOR_COUNT] = {SIM_START_X + SIM_START_Y, SIM_START_Y - SIM_START_X};
+    simSetMotorSteps(start);
+    simAddLimitSwitch(SIM_LIMIT_INNER, SIM_AXIS_Y, hysteresis);
+    simAddLimitSwitch(SIM_LIMIT_OUTER, SIM_AXIS_X, hysteresis);
+
+    setupMotion();
+    motionSetStartCallback(onStarted);
+    int encoders = simLiveEncoders();
+
+    fprintf(report, "%-22s %5s %8s %8s %9s %9s %5s %5s %5s %5s %9s\n", "game", "cmds", "time_s", "busy_s",
+            "m1_steps", "m2_steps", "dir", "slp", "rst", "em", "error");
+    int failed = 0;
+    for (int i = first; i < argc; i++) {
+        const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        SimStats before = *simGetStats();
+        int failuresBefore = simFailures();
+        game = (Game) {
+                .name = name,
+                .firstStartUs = -1,
+        };
+        if (!playGame(argv[i])) {
+            failed++;
+            continue;
+        }
+
+        const SimStats *after = simGetStats();
+        int32_t errorX;
+        int32_t errorY;
+        int32_t error = positionError(&errorX, &errorY);
+        int64_t spanUs = game.firstStartUs < 0 ? 0 : game.lastDoneUs - game.firstStartUs;
+        fprintf(report, "%-22s %5d %8.3f %8.3f %9" PRId64 " %9" PRId64 " %5" PRIu32 " %5" PRIu32 " %5" PRIu32
+                        " %5" PRIu32 " %4" PRId32 ",%-4" PRId32 "\n",
+                name, game.commands, spanUs / 1e6, game.busyUs / 1e6, after->steps[0] - before.steps[0],
+                after->steps[1] - before.steps[1], transitions(&before, SIM_DIR1, SIM_DIR2),
+                transitions(&before, SIM_SLP1, SIM_SLP2), transitions(&before, SIM_RST1, SIM_RST2),
+                transitions(&before, SIM_EM_TOGGLE, SIM_EM_TOGGLE), errorX, errorY);
+
+        if (simLiveEncoders() != encoders) {
+            fprintf(stderr, "%s: %d RMT encoders leaked\n", name, simLiveEncoders() - encoders);
+            game.failed++;
+        }
+        if (game.failed > 0 || error > 0 || simFailures() > failuresBefore) {
+            failed++;
+        }
+    }
+
+    if (trace) {
+        fclose(trace);
+    }
+    if (failed) {
+        fprintf(report, "%d of %d games failed\n", failed, argc - first);
+    } else {
+        fprintf(report, "All games passed\n");
+    }
+    fclose(report);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,817 @@
+#include <inttypes.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "driver/rmt_tx.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "sim_hw.h"
+
+#define SIM_MAX_CHANNELS 4
+#define SIM_MAX_SWITCHES 4
+// Hardware limit of the S3 loop counter
+#define SIM_MAX_LOOP_COUNT 1023
+#define SIM_TICK_NS (1000000000LL / configTICK_RATE_HZ)
+#define SIM_FOREVER INT64_MAX
+
+typedef struct {
+    rmt_symbol_word_t *symbols;
+    size_t count;
+    uint32_t loops;  // Times the symbols are sent, at least once
+} SimTransaction;
+
+struct rmt_channel_t {
+    int motor;
+    uint32_t resolutionHz;
+    size_t queueDepth;
+    bool enabled;
+    rmt_tx_done_callback_t onDone;
+    void *ctx;
+    SimTransaction *queue;  // queue[0] is running or waiting for its sync group
+    size_t queued;
+    size_t queueSize;
+    SimTransaction encoding;  // Filled by the copy encoder during rmt_transmit()
+    bool running;
+    size_t symbol;
+    uint32_t loop;
+    bool rose;  // The current symbol has already raised STEP
+    int64_t symbolStartNs;
+    int64_t transactionStartNs;
+    struct rmt_sync_manager_t *sync;
+};
+
+struct rmt_sync_manager_t {
+    rmt_channel_handle_t channels[SIM_MAX_CHANNELS];
+    size_t count;
+    uint32_t transmitted[SIM_MAX_CHANNELS];  // Transactions queued on each channel while in the group
+    bool disabled;  // A channel was stopped, its counts no longer have to match
+};
+
+typedef struct {
+    gpio_num_t step;
+    gpio_num_t dir;
+    gpio_num_t reset;
+    int32_t position;
+} SimMotor;
+
+typedef struct {
+    gpio_num_t gpio;
+    SimAxis axis;
+    int32_t releaseSteps;
+    bool closed;
+} SimSwitch;
+
+typedef struct {
+    gpio_mode_t mode;
+    gpio_int_type_t intrType;
+    int level;
+    gpio_isr_t isr;
+    void *isrArg;
+} SimGpio;
+
+struct SimQueue {
+    uint8_t *items;
+    size_t itemSize;
+    size_t length;
+    size_t first;
+    size_t count;
+};
+
+struct SimEventGroup {
+    EventBits_t bits;
+};
+
+struct SimTask {
+    TaskFunction_t function;
+    void *arg;
+};
+
+typedef struct {
+    rmt_encoder_t base;
+} SimCopyEncoder;
+
+static int64_t nowNs = 0;
+static SimStats stats;
+static int failures = 0;
+static FILE *traceFile = NULL;
+static int logLevel = ESP_LOG_WARN;
+
+static SimMotor motors[SIM_MOTOR_COUNT];
+static int motorCount = 0;
+static SimSwitch switches[SIM_MAX_SWITCHES];
+static int switchCount = 0;
+static SimGpio gpios[SIM_GPIO_COUNT];
+static struct rmt_channel_t channels[SIM_MAX_CHANNELS];
+static int channelCount = 0;
+static int liveCopyEncoders = 0;
+
+static struct SimTask task;
+static bool taskCreated = false;
+static bool inTask = false;
+static jmp_buf taskBlocked;
+static uint32_t notifyValue = 0;
+static bool notifyPending = false;
+
+static void simFail(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+static void simFail(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "SIM FAIL at %.6f s: ", nowNs / 1e9);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    failures++;
+}
+
+/* Something the firmware could never recover from, like a task waiting forever */
+static void simFatal(const char *message) {
+    fprintf(stderr, "SIM FATAL at %.6f s: %s\n", nowNs / 1e9, message);
+    exit(2);
+}
+
+void simCheckFailed(esp_err_t code, const char *expression, const char *file, int line) {
+    fprintf(stderr, "SIM FATAL at %.6f s: ESP_ERROR_CHECK failed: %s (%s) at %s:%d\n", nowNs / 1e9,
+            esp_err_to_name(code), expression, file, line);
+    exit(2);
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+void simLog(esp_log_level_t level, const char *tag, const char *format, ...) {
+    static const char letters[] = "NEWIDV";
+    if ((int) level > logLevel) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    printf("%c (%.6f) %s: ", letters[level], nowNs / 1e9, tag);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+}
+
+int64_t esp_timer_get_time() {
+    return nowNs / 1000;
+}
+
+/*
+ * GPIO and switches
+ */
+
+static void setPin(gpio_num_t gpio, int level) {
+    SimGpio *pin = &gpios[gpio];
+    if (pin->level == level) {
+        return;
+    }
+    int previous = pin->level;
+    pin->level = level;
+    stats.transitions[gpio]++;
+    if (traceFile) {
+        fprintf(traceFile, "%" PRId64 ",gpio,%d,%d\n", nowNs, gpio, level);
+    }
+    bool falling = previous && !level;
+    if (pin->isr && ((falling && (pin->intrType == GPIO_INTR_NEGEDGE || pin->intrType == GPIO_INTR_ANYEDGE)) ||
+                     (!falling && (pin->intrType == GPIO_INTR_POSEDGE || pin->intrType == GPIO_INTR_ANYEDGE)))) {
+        pin->isr(pin->isrArg);
+    }
+}
+
+static void updateSwitches() {
+    for (int i = 0; i < switchCount; i++) {
+        SimSwitch *limit = &switches[i];
+        int32_t distance = limit->axis == SIM_AXIS_X ? motors[0].position - motors[1].position
+                                                     : motors[0].position + motors[1].position;
+        if (!limit->closed && distance <= 0) {
+            limit->closed = true;
+        } else if (limit->closed && distance > limit->releaseSteps) {
+            limit->closed = false;
+        } else {
+            continue;
+        }
+        // Pulled up, so a closed switch reads low
+        setPin(limit->gpio, !limit->closed);
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    for (int i = 0; i < SIM_GPIO_COUNT; i++) {
+        if (config->pin_bit_mask & (1ULL << i)) {
+            gpios[i].mode = config->mode;
+            gpios[i].intrType = config->intr_type;
+            if (config->mode == GPIO_MODE_INPUT && config->pull_up_en) {
+                gpios[i].level = 1;
+            }
+        }
+    }
+    // Switches already closed read low from the start
+    for (int i = 0; i < switchCount; i++) {
+        gpios[switches[i].gpio].level = !switches[i].closed;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    if (gpios[gpio_num].mode != GPIO_MODE_OUTPUT) {
+        simFail("gpio_set_level(%d) on a pin that is not an output", gpio_num);
+    }
+    setPin(gpio_num, level != 0);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    return gpios[gpio_num].level;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+    gpios[gpio_num].isr = isr_handler;
+    gpios[gpio_num].isrArg = args;
+    return ESP_OK;
+}
+
+void simAddMotor(gpio_num_t step, gpio_num_t dir, gpio_num_t reset) {
+    motors[motorCount++] = (SimMotor) {
+            .step = step,
+            .dir = dir,
+            .reset = reset,
+    };
+}
+
+void simAddLimitSwitch(gpio_num_t gpio, SimAxis axis, int32_t releaseSteps) {
+    switches[switchCount++] = (SimSwitch) {
+            .gpio = gpio,
+            .axis = axis,
+            .releaseSteps = releaseSteps,
+    };
+    gpios[gpio].level = 1;
+    updateSwitches();
+}
+
+void simSetMotorSteps(const int32_t steps[SIM_MOTOR_COUNT]) {
+    for (int i = 0; i < SIM_MOTOR_COUNT; i++) {
+        motors[i].position = steps[i];
+    }
+    updateSwitches();
+}
+
+void simGetMotorSteps(int32_t steps[SIM_MOTOR_COUNT]) {
+    for (int i = 0; i < SIM_MOTOR_COUNT; i++) {
+        steps[i] = motors[i].position;
+    }
+}
+
+/*
+ * RMT
+ */
+
+static int64_t ticksToNs(const struct rmt_channel_t *channel, uint32_t ticks) {
+    return (int64_t) ticks * 1000000000LL / channel->resolutionHz;
+}
+
+static void stepPulse(struct rmt_channel_t *channel) {
+    SimMotor *motor = &motors[channel->motor];
+    if (!gpios[motor->reset].level) {
+        simFail("motor %d stepped while its driver is held in reset", channel->motor + 1);
+    }
+    motor->position += gpios[motor->dir].level ? 1 : -1;
+    stats.steps[channel->motor]++;
+    if (traceFile) {
+        fprintf(traceFile, "%" PRId64 ",step,%d,%" PRId32 "\n", nowNs, channel->motor + 1, motor->position);
+    }
+    updateSwitches();
+}
+
+static void startTransaction(struct rmt_channel_t *channel) {
+    channel->running = true;
+    channel->symbol = 0;
+    channel->loop = 0;
+    channel->rose = false;
+    channel->symbolStartNs = nowNs;
+    channel->transactionStartNs = nowNs;
+}
+
+/* Start whatever can start now. A sync group starts its next transactions together, once all have one. */
+static void startChannels() {
+    for (int i = 0; i < channelCount; i++) {
+        struct rmt_channel_t *channel = &channels[i];
+        if (channel->running || !channel->enabled || channel->queued == 0) {
+            continue;
+        }
+        struct rmt_sync_manager_t *sync = channel->sync;
+        if (!sync) {
+            startTransaction(channel);
+            continue;
+        }
+        bool ready = true;
+        for (size_t j = 0; j < sync->count; j++) {
+            const struct rmt_channel_t *member = sync->channels[j];
+            ready = ready && !member->running && member->enabled && member->queued > 0;
+        }
+        if (ready) {
+            for (size_t j = 0; j < sync->count; j++) {
+                startTransaction(sync->channels[j]);
+            }
+        }
+    }
+}
+
+static void dropTransaction(struct rmt_channel_t *channel) {
+    free(channel->queue[0].symbols);
+    channel->queued--;
+    memmove(&channel->queue[0], &channel->queue[1], channel->queued * sizeof(SimTransaction));
+}
+
+static void finishTransaction(struct rmt_channel_t *channel) {
+    const SimTransaction *done = &channel->queue[0];
+    rmt_tx_done_event_data_t event = {
+            .num_symbols = done->count,
+    };
+    stats.transactions++;
+    if (traceFile) {
+        fprintf(traceFile, "%" PRId64 ",tx,%d,%" PRIu64 "\n", nowNs, channel->motor + 1,
+                (uint64_t) done->count * done->loops);
+    }
+    dropTransaction(channel);
+    channel->running = false;
+    if (channel->onDone) {
+        channel->onDone(channel, &event, channel->ctx);
+    }
+}
+
+static int64_t nextEventNs(const struct rmt_channel_t *channel) {
+    const rmt_symbol_word_t *symbol = &channel->queue[0].symbols[channel->symbol];
+    int64_t low = ticksToNs(channel, symbol->duration0);
+    return channel->symbolStartNs + (channel->rose ? low + ticksToNs(channel, symbol->duration1) : low);
+}
+
+static void runChannelEvent(struct rmt_channel_t *channel) {
+    if (!channel->rose) {
+        // Symbols are low then high, so the step is taken on the rising edge in the middle
+        channel->rose = true;
+        stepPulse(channel);
+        return;
+    }
+
+    const SimTransaction *current = &channel->queue[0];
+    channel->rose = false;
+    channel->symbolStartNs = nowNs;
+    if (++channel->symbol < current->count) {
+        return;
+    }
+    channel->symbol = 0;
+    if (++channel->loop < current->loops) {
+        return;
+    }
+    finishTransaction(channel);
+    startChannels();
+}
+
+/*
+ * Let the channels run until the given time, or until a notification is pending when stopOnNotify
+ * is set. Returns false if nothing was left to happen before the time.
+ */
+static bool runUntil(int64_t untilNs, bool stopOnNotify) {
+    for (;;) {
+        if (stopOnNotify && notifyPending) {
+            return true;
+        }
+        struct rmt_channel_t *next = NULL;
+        int64_t nextNs = SIM_FOREVER;
+        for (int i = 0; i < channelCount; i++) {
+            if (channels[i].running) {
+                int64_t eventNs = nextEventNs(&channels[i]);
+                if (eventNs < nextNs) {
+                    nextNs = eventNs;
+                    next = &channels[i];
+                }
+            }
+        }
+        if (!next || nextNs > untilNs) {
+            if (untilNs == SIM_FOREVER) {
+                return false;
+            }
+            nowNs = untilNs;
+            return true;
+        }
+        nowNs = nextNs;
+        runChannelEvent(next);
+    }
+}
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan) {
+    int motor = -1;
+    for (int i = 0; i < motorCount; i++) {
+        if (motors[i].step == config->gpio_num) {
+            motor = i;
+        }
+    }
+    if (motor < 0 || channelCount == SIM_MAX_CHANNELS || config->resolution_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct rmt_channel_t *channel = &channels[channelCount++];
+    *channel = (struct rmt_channel_t) {
+            .motor = motor,
+            .resolutionHz = config->resolution_hz,
+            .queueDepth = config->trans_queue_depth,
+    };
+    *ret_chan = channel;
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t tx_channel, const rmt_tx_event_callbacks_t *cbs,
+                                          void *user_data) {
+    tx_channel->onDone = cbs->on_trans_done;
+    tx_channel->ctx = user_data;
+    return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel) {
+    if (channel->enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    channel->enabled = true;
+    startChannels();
+    return ESP_OK;
+}
+
+/* Stops the channel straight away and drops everything still queued, without done events */
+esp_err_t rmt_disable(rmt_channel_handle_t channel) {
+    if (!channel->enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (channel->running) {
+        stats.abortedTransactions++;
+        if (traceFile) {
+            fprintf(traceFile, "%" PRId64 ",tx_abort,%d,0\n", nowNs, channel->motor + 1);
+        }
+    }
+    while (channel->queued > 0) {
+        dropTransaction(channel);
+    }
+    channel->running = false;
+    channel->enabled = false;
+    if (channel->sync) {
+        channel->sync->disabled = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t tx_channel, rmt_encoder_handle_t encoder, const void *payload,
+                       size_t payload_bytes, const rmt_transmit_config_t *config) {
+    if (!tx_channel->enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config->loop_count < 0 || config->loop_count > SIM_MAX_LOOP_COUNT) {
+        simFail("loop_count %d outside 0..%d", config->loop_count, SIM_MAX_LOOP_COUNT);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (tx_channel->queued >= tx_channel->queueDepth) {
+        // The real driver would block here until a slot frees up, which the motion task never expects
+        simFail("rmt_transmit on motor %d with all %zu queue slots busy", tx_channel->motor + 1,
+                tx_channel->queueDepth);
+    }
+
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    tx_channel->encoding = (SimTransaction) {
+            .loops = config->loop_count > 0 ? config->loop_count : 1,
+    };
+    encoder->encode(encoder, tx_channel, payload, payload_bytes, &state);
+    SimTransaction transaction = tx_channel->encoding;
+    tx_channel->encoding = (SimTransaction) {0};
+    if (!(state & RMT_ENCODING_COMPLETE) || transaction.count == 0) {
+        simFail("transaction on motor %d encoded %zu symbols without completing", tx_channel->motor + 1,
+                transaction.count);
+        free(transaction.symbols);
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < transaction.count; i++) {
+        if (transaction.symbols[i].duration0 == 0 || transaction.symbols[i].duration1 == 0) {
+            simFail("zero length half period in symbol %zu on motor %d", i, tx_channel->motor + 1);
+        }
+    }
+
+    if (tx_channel->queued == tx_channel->queueSize) {
+        tx_channel->queueSize = tx_channel->queueSize ? 2 * tx_channel->queueSize : tx_channel->queueDepth;
+        tx_channel->queue = realloc(tx_channel->queue, tx_channel->queueSize * sizeof(SimTransaction));
+    }
+    tx_channel->queue[tx_channel->queued++] = transaction;
+    struct rmt_sync_manager_t *sync = tx_channel->sync;
+    if (sync) {
+        for (size_t i = 0; i < sync->count; i++) {
+            sync->transmitted[i] += sync->channels[i] == tx_channel;
+        }
+    }
+    startChannels();
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_sync_manager(const rmt_sync_manager_config_t *config, rmt_sync_manager_handle_t *ret_synchro) {
+    if (config->array_size < 2 || config->array_size > SIM_MAX_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < config->array_size; i++) {
+        rmt_channel_handle_t channel = config->tx_channel_array[i];
+        if (channel->sync || channel->running || channel->queued > 0) {
+            simFail("sync manager created over a busy or already synchronised channel");
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    struct rmt_sync_manager_t *sync = calloc(1, sizeof(*sync));
+    sync->count = config->array_size;
+    for (size_t i = 0; i < sync->count; i++) {
+        sync->channels[i] = config->tx_channel_array[i];
+        sync->channels[i]->sync = sync;
+    }
+    *ret_synchro = sync;
+    return ESP_OK;
+}
+
+/*
+ * Every channel of a group has to get the same number of transactions, otherwise the last ones
+ * wait forever for a partner. Only a group that was stopped early may differ.
+ */
+esp_err_t rmt_del_sync_manager(rmt_sync_manager_handle_t synchro) {
+    for (size_t i = 0; i < synchro->count; i++) {
+        if (!synchro->disabled && synchro->transmitted[i] != synchro->transmitted[0]) {
+            simFail("synchronised channels got %" PRIu32 " and %" PRIu32 " transactions", synchro->transmitted[0],
+                    synchro->transmitted[i]);
+        }
+        if (!synchro->disabled && (synchro->channels[i]->running || synchro->channels[i]->queued > 0)) {
+            simFail("sync manager deleted while motor %d still transmits", synchro->channels[i]->motor + 1);
+        }
+        synchro->channels[i]->sync = NULL;
+    }
+    free(synchro);
+    startChannels();
+    return ESP_OK;
+}
+
+static size_t copyEncode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data,
+                         size_t data_size, rmt_encode_state_t *ret_state) {
+    SimTransaction *transaction = &channel->encoding;
+    size_t count = data_size / sizeof(rmt_symbol_word_t);
+    transaction->symbols = realloc(transaction->symbols, (transaction->count + count) * sizeof(rmt_symbol_word_t));
+    memcpy(&transaction->symbols[transaction->count], primary_data, count * sizeof(rmt_symbol_word_t));
+    transaction->count += count;
+    *ret_state = RMT_ENCODING_COMPLETE;
+    return count;
+}
+
+static esp_err_t copyReset(rmt_encoder_t *encoder) {
+    return ESP_OK;
+}
+
+static esp_err_t copyDelete(rmt_encoder_t *encoder) {
+    liveCopyEncoders--;
+    free(__containerof(encoder, SimCopyEncoder, base));
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder) {
+    SimCopyEncoder *encoder = calloc(1, sizeof(*encoder));
+    encoder->base = (rmt_encoder_t) {
+            .encode = copyEncode,
+            .reset = copyReset,
+            .del = copyDelete,
+    };
+    liveCopyEncoders++;
+    *ret_encoder = &encoder->base;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder) {
+    return encoder->del(encoder);
+}
+
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder) {
+    return encoder->reset(encoder);
+}
+
+/*
+ * FreeRTOS, for the single task motion.c creates. The task runs whenever the simulation driver
+ * calls simRunTasks() or blocks sending to a full queue, and gives control back once it would
+ * block forever.
+ */
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t core) {
+    if (taskCreated) {
+        simFatal("only one task can be simulated");
+    }
+    task = (struct SimTask) {
+            .function = function,
+            .arg = arg,
+    };
+    taskCreated = true;
+    if (createdTask) {
+        *createdTask = &task;
+    }
+    return pdPASS;
+}
+
+/* The task keeps no state on its stack between commands, so it is simply started over each time */
+void simRunTasks() {
+    if (!taskCreated || inTask) {
+        return;
+    }
+    inTask = true;
+    if (setjmp(taskBlocked) == 0) {
+        task.function(task.arg);
+    }
+    inTask = false;
+}
+
+static void blockForever() {
+    if (!inTask) {
+        simFatal("the simulation driver would block forever");
+    }
+    longjmp(taskBlocked, 1);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    runUntil(nowNs + (int64_t) ticks * SIM_TICK_NS, false);
+}
+
+TickType_t xTaskGetTickCount() {
+    return nowNs / SIM_TICK_NS;
+}
+
+static BaseType_t notify(uint32_t value, eNotifyAction action) {
+    if (action == eSetBits) {
+        notifyValue |= value;
+    } else if (action == eIncrement) {
+        notifyValue++;
+    }
+    notifyPending = true;
+    return pdPASS;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    return notify(value, action);
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken) {
+    if (woken) {
+        *woken = pdTRUE;
+    }
+    return notify(value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t ticks) {
+    if (!notifyPending) {
+        notifyValue &= ~clearOnEntry;
+        if (ticks > 0) {
+            int64_t untilNs = ticks == portMAX_DELAY ? SIM_FOREVER : nowNs + (int64_t) ticks * SIM_TICK_NS;
+            if (!runUntil(untilNs, true)) {
+                for (int i = 0; i < channelCount; i++) {
+                    if (channels[i].queued > 0) {
+                        simFatal("transactions wait for a sync group partner that never gets one");
+                    }
+                }
+                simFatal("the motion task waits for a notification nothing will send");
+            }
+        }
+    }
+    if (value) {
+        *value = notifyValue;
+    }
+    if (!notifyPending) {
+        return pdFALSE;
+    }
+    notifyPending = false;
+    notifyValue &= ~clearOnExit;
+    return pdTRUE;
+}
+
+BaseType_t xTaskNotifyStateClear(TaskHandle_t task) {
+    BaseType_t wasPending = notifyPending;
+    notifyPending = false;
+    return wasPending;
+}
+
+uint32_t ulTaskNotifyValueClear(TaskHandle_t task, uint32_t bits) {
+    uint32_t previous = notifyValue;
+    notifyValue &= ~bits;
+    return previous;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    struct SimQueue *queue = calloc(1, sizeof(*queue));
+    queue->items = calloc(length, itemSize);
+    queue->itemSize = itemSize;
+    queue->length = length;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    if (queue->count == queue->length) {
+        // Whoever is sending waits for the task to make room
+        simRunTasks();
+        if (queue->count == queue->length) {
+            return pdFALSE;
+        }
+    }
+    memcpy(queue->items + ((queue->first + queue->count) % queue->length) * queue->itemSize, item,
+           queue->itemSize);
+    queue->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    if (queue->count == 0) {
+        if (ticks == portMAX_DELAY) {
+            blockForever();
+        }
+        // Only the driver fills the queue and it isn't running now, so nothing arrives meanwhile
+        runUntil(nowNs + (int64_t) ticks * SIM_TICK_NS, false);
+        return pdFALSE;
+    }
+    memcpy(item, queue->items + queue->first * queue->itemSize, queue->itemSize);
+    queue->first = (queue->first + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    return calloc(1, sizeof(struct SimEventGroup));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit,
+                                BaseType_t waitForAll, TickType_t ticks) {
+    bool set = waitForAll ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    if (!set && ticks > 0) {
+        // Waiting for the motion task to get there, run it until it blocks
+        simRunTasks();
+        set = waitForAll ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    }
+    EventBits_t current = group->bits;
+    if (set && clearOnExit) {
+        group->bits &= ~bits;
+    }
+    return current;
+}
+
+/*
+ * Simulation control
+ */
+
+void simSetTrace(FILE *trace) {
+    traceFile = trace;
+    if (traceFile) {
+        fprintf(traceFile, "time_ns,event,id,value\n");
+    }
+}
+
+void simSetLogLevel(int level) {
+    logLevel = level;
+}
+
+int64_t simNowNs() {
+    return nowNs;
+}
+
+const SimStats *simGetStats() {
+    return &stats;
+}
+
+int simFailures() {
+    return failures;
+}
+
+int simLiveEncoders() {
+    return liveCopyEncoders;
+}
@@ -0,0 +1,67 @@
+#ifndef ESP32_BOARDCODE_SIM_HW_H
+#define ESP32_BOARDCODE_SIM_HW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "driver/gpio.h"
+
+/*
+ * Simulated hardware under motion.c: RMT TX channels that step the motors symbol by symbol, GPIOs,
+ * limit switches that follow the head and just enough of FreeRTOS to run the motion task, all on
+ * a simulated clock. Anything the real driver would reject or block on forever fails the run.
+ */
+
+#define SIM_MOTOR_COUNT 2
+
+typedef enum {
+    SIM_AXIS_X,  // Closed while motor1 - motor2 <= 0, that is x <= 0
+    SIM_AXIS_Y,  // Closed while motor1 + motor2 <= 0, that is y <= 0
+} SimAxis;
+
+typedef struct {
+    int64_t steps[SIM_MOTOR_COUNT];  // STEP pulses per motor
+    uint32_t transactions;
+    uint32_t abortedTransactions;  // Cut short by rmt_disable()
+    uint32_t transitions[SIM_GPIO_COUNT];  // Level changes per GPIO
+} SimStats;
+
+/*
+ * Describe the wiring, before setupMotion(). Motors are numbered in the order they are added and
+ * a STEP pulse moves one a step in the direction its DIR level says, 1 being positive.
+ */
+void simAddMotor(gpio_num_t step, gpio_num_t dir, gpio_num_t reset);
+
+/*
+ * A normally open switch to ground that closes once the head reaches 0 on axis, and opens again
+ * only once it is more than releaseSteps (in motor1 -/+ motor2 units) past that.
+ */
+void simAddLimitSwitch(gpio_num_t gpio, SimAxis axis, int32_t releaseSteps);
+
+/* Put the head somewhere, in signed steps per motor */
+void simSetMotorSteps(const int32_t steps[SIM_MOTOR_COUNT]);
+void simGetMotorSteps(int32_t steps[SIM_MOTOR_COUNT]);
+
+/* Write every step, GPIO change and transaction as CSV, NULL to stop */
+void simSetTrace(FILE *trace);
+
+/* Log level for ESP_LOGx, to stdout like the firmware */
+void simSetLogLevel(int level);
+
+/*
+ * Run the tasks created through xTaskCreatePinnedToCore() until they block with nothing left
+ * that could wake them.
+ */
+void simRunTasks();
+
+int64_t simNowNs();
+const SimStats *simGetStats();
+
+/* Problems found in the driver usage so far, each reported to stderr as it happened */
+int simFailures();
+
+/* RMT encoders currently allocated, the encoders built for a single move must not pile up */
+int simLiveEncoders();
+
+#endif //ESP32_BOARDCODE_SIM_HW_H
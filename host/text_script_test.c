@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "text_script.h"
+
+#define MAX_COMMANDS 16
+// What the collector records for a command dropped for its length
+#define DROPPED "<dropped>"
+
+static int failures = 0;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+/* Every command the tokenizer passed on, in order */
+typedef struct {
+    char commands[MAX_COMMANDS][TEXT_COMMAND_MAX_LENGTH + 1];
+    int count;
+} Collected;
+
+static void collect(char *command, void *ctx) {
+    Collected *collected = ctx;
+    if (collected->count < MAX_COMMANDS) {
+        snprintf(collected->commands[collected->count], sizeof(collected->commands[0]), "%s",
+                 command ? command : DROPPED);
+    }
+    collected->count++;
+}
+
+static void checkCommands(const Collected *collected, const char *const *expected, int count, const char *what) {
+    CHECK(collected->count == count, "%s: %d commands, expected %d", what, collected->count, count);
+    for (int i = 0; i < count && i < collected->count; i++) {
+        CHECK(strcmp(collected->commands[i], expected[i]) == 0, "%s: command %d is \"%s\", expected \"%s\"", what, i,
+              collected->commands[i], expected[i]);
+    }
+}
+
+/* Tokenize script in one go, with textScriptFinish() */
+static void tokenize(const char *script, Collected *collected) {
+    TextScriptTokenizer tokenizer;
+    *collected = (Collected) {0};
+    textScriptInit(&tokenizer, collect, collected);
+    textScriptFeed(&tokenizer, script, strlen(script));
+    textScriptFinish(&tokenizer);
+}
+
+/* Wherever the transport splits the script, the same commands come out */
+static void testSplitAtEveryBoundary() {
+    const char script[] = "MVNO2,HM,MG1,GO3.5:2,TMRwhite to move";
+    const char *const expected[] = {"MVNO2", "HM", "MG1", "GO3.5:2", "TMRwhite to move"};
+    size_t length = strlen(script);
+
+    for (size_t split = 0; split <= length; split++) {
+        Collected collected = {0};
+        TextScriptTokenizer tokenizer;
+        textScriptInit(&tokenizer, collect, &collected);
+        textScriptFeed(&tokenizer, script, split);
+        textScriptFeed(&tokenizer, script + split, length - split);
+        textScriptFinish(&tokenizer);
+        char what[32];
+        snprintf(what, sizeof(what), "split at %zu", split);
+        checkCommands(&collected, expected, 5, what);
+    }
+
+    Collected collected = {0};
+    TextScriptTokenizer tokenizer;
+    textScriptInit(&tokenizer, collect, &collected);
+    for (size_t i = 0; i < length; i++) {
+        textScriptFeed(&tokenizer, script + i, 1);
+    }
+    textScriptFinish(&tokenizer);
+    checkCommands(&collected, expected, 5, "byte by byte");
+}
+
+/* Runs of delimiters, and a NUL sent along with the script, don't make empty commands */
+static void testDelimiterRuns() {
+    Collected collected;
+    const char *const expected[] = {"MVNO2", "HM"};
+    tokenize(",,MVNO2,,,HM,,", &collected);
+    checkCommands(&collected, expected, 2, "comma runs");
+
+    TextScriptTokenizer tokenizer;
+    collected = (Collected) {0};
+    textScriptInit(&tokenizer, collect, &collected);
+    textScriptFeed(&tokenizer, "MVNO2,HM\0", 9);
+    CHECK(collected.count == 2, "NUL didn't end the last command, %d commands", collected.count);
+    textScriptFinish(&tokenizer);
+    checkCommands(&collected, expected, 2, "NUL terminated");
+}
+
+/* A trailing delimiter leaves nothing for textScriptFinish() to pass on */
+static void testFinish() {
+    Collected collected = {0};
+    TextScriptTokenizer tokenizer;
+    const char *const expected[] = {"HM", "MG1"};
+
+    textScriptInit(&tokenizer, collect, &collected);
+    textScriptFeed(&tokenizer, "HM,MG1", 6);
+    CHECK(collected.count == 1, "pending command passed on before the finish, %d commands", collected.count);
+    textScriptFinish(&tokenizer);
+    checkCommands(&collected, expected, 2, "pending command");
+    textScriptFinish(&tokenizer);
+    CHECK(collected.count == 2, "second finish passed on %d commands", collected.count - 2);
+
+    tokenize("HM,MG1,", &collected);
+    checkCommands(&collected, expected, 2, "empty trailing command");
+
+    tokenize("", &collected);
+    CHECK(collected.count == 0, "empty script passed on %d commands", collected.count);
+}
+
+/* Overlong commands are reported as dropped, the ones around them pass through */
+static void testOverflow() {
+    char longest[TEXT_COMMAND_MAX_LENGTH + 1];
+    memset(longest, 'X', TEXT_COMMAND_MAX_LENGTH);
+    longest[TEXT_COMMAND_MAX_LENGTH] = '\0';
+    char script[3 * TEXT_COMMAND_MAX_LENGTH];
+    Collected collected;
+
+    snprintf(script, sizeof(script), "HM,%s,MG1", longest);
+    tokenize(script, &collected);
+    const char *const fitting[] = {"HM", longest, "MG1"};
+    checkCommands(&collected, fitting, 3, "longest command");
+
+    snprintf(script, sizeof(script), "HM,%sX,MG1", longest);
+    tokenize(script, &collected);
+    const char *const dropped[] = {"HM", DROPPED, "MG1"};
+    checkCommands(&collected, dropped, 3, "overlong command");
+
+    // Overlong at the end of the script, and across chunks
+    snprintf(script, sizeof(script), "HM,%sX", longest);
+    size_t length = strlen(script);
+    TextScriptTokenizer tokenizer;
+    collected = (Collected) {0};
+    textScriptInit(&tokenizer, collect, &collected);
+    textScriptFeed(&tokenizer, script, length / 2);
+    textScriptFeed(&tokenizer, script + length / 2, length - length / 2);
+    textScriptFinish(&tokenizer);
+    checkCommands(&collected, dropped, 2, "overlong last command");
+}
+
+static void testParse() {
+    ScriptCommand parsed;
+    CHECK(parseTextCommand("MVNE7", &parsed) && parsed.type == SCRIPT_MOVE && parsed.dir == NE &&
+          parsed.numHalfTiles == 7, "MVNE7 parsed as type %d dir %d %f", parsed.type, parsed.dir,
+          parsed.numHalfTiles);
+    CHECK(parseTextCommand("GOe4", &parsed) && parsed.type == SCRIPT_GOTO && parsed.xTiles == 4 &&
+          parsed.yTiles == 3, "GOe4 parsed as %f:%f", parsed.xTiles, parsed.yTiles);
+    CHECK(parseTextCommand("GO8.5:-0.5", &parsed) && parsed.xTiles == 8.5 && parsed.yTiles == -0.5,
+          "GO8.5:-0.5 parsed as %f:%f", parsed.xTiles, parsed.yTiles);
+    CHECK(!parseTextCommand("GO8.5", &parsed), "GO without y parsed");
+    CHECK(!parseTextCommand("MG2", &parsed), "MG2 parsed");
+    CHECK(!parseTextCommand("XX", &parsed), "unknown command parsed");
+}
+
+int main() {
+    testSplitAtEveryBoundary();
+    testDelimiterRuns();
+    testFinish();
+    testOverflow();
+    testParse();
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "binary_protocol.h"
+
+static uint16_t readUint16(const uint8_t *data) {
+    return data[0] | data[1] << 8;
+}
+
+BinaryDecodeResult decodeBinaryCommand(const uint8_t *frame, size_t length, size_t *offset, BinaryCommand *command) {
+    if (*offset == 0) {
+        if (length == 0 || frame[0] != BINARY_FRAME_V1) {
+            return BINARY_DECODE_ERROR;
+        }
+        *offset = 1;
+    }
+    if (*offset == length) {
+        return BINARY_DECODE_END;
+    }
+    if (length - *offset < BINARY_RECORD_SIZE) {
+        return BINARY_DECODE_ERROR;
+    }
+
+    const uint8_t *record = frame + *offset;
+    *command = (BinaryCommand) {
+            .opcode = record[0],
+            .arg = record[1],
+            .x = (int16_t) readUint16(record + 2),
+            .y = (int16_t) readUint16(record + 4),
+            .speed = record[6],
+            .sequence = readUint16(record + 8),
+            .payload = NULL,
+    };
+
+    // Every move runs the default profile, so a client asking for another speed is told so
+    if (command->speed != 0) {
+        return BINARY_DECODE_ERROR;
+    }
+
+    size_t recordLength = BINARY_RECORD_SIZE;
+    switch (command->opcode) {
+        case BINARY_OP_MOVE:
+            if (command->arg > 7 || command->x < 0) {
+                return BINARY_DECODE_ERROR;
+            }
+            break;
+        case BINARY_OP_MAGNET:
+            if (command->arg > 1) {
+                return BINARY_DECODE_ERROR;
+            }
+            break;
+        case BINARY_OP_CLOCK:
+            if (command->arg > BINARY_CLOCK_MAX_LENGTH || length - *offset - BINARY_RECORD_SIZE < command->arg) {
+                return BINARY_DECODE_ERROR;
+            }
+            command->payload = record + BINARY_RECORD_SIZE;
+            recordLength += command->arg;
+            break;
+        case BINARY_OP_HOME:
+        case BINARY_OP_GOTO:
+            break;
+        default:
+            return BINARY_DECODE_ERROR;
+    }
+    *offset += recordLength;
+    return BINARY_DECODE_OK;
+}
+
+uint16_t binaryRecordSequence(const uint8_t *frame, size_t length, size_t offset) {
+    if (offset == 0 || offset > length || length - offset < BINARY_RECORD_SIZE) {
+        return 0;
+    }
+    return readUint16(frame + offset + 8);
+}
@@ -0,0 +1,78 @@
+#ifndef ESP32_BOARDCODE_BINARY_PROTOCOL_H
+#define ESP32_BOARDCODE_BINARY_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary scripts for the motor characteristic, an alternative to the comma separated text. A frame
+ * starts with a version byte, which is never ASCII so it can't be mistaken for a text script,
+ * followed by fixed size records:
+ *
+ *   0     opcode
+ *   1     argument: direction for MOVE, 1/0 for MAGNET, payload length for CLOCK
+ *   2-3   MOVE: half tiles, GOTO: x in tiles from a1, signed 8.8 fixed point, little endian
+ *   4-5   GOTO: y in tiles from a1, signed 8.8 fixed point, little endian
+ *   6     speed, reserved for speed profiles and must be 0 until they are applied
+ *   7     reserved, 0
+ *   8-9   sequence id, little endian
+ *
+ * A CLOCK record is followed by its payload, the same message a TM text command carries.
+ */
+#define BINARY_FRAME_V1 0x81
+#define BINARY_RECORD_SIZE 10
+#define BINARY_CLOCK_MAX_LENGTH 32
+
+typedef enum {
+    BINARY_OP_MOVE = 0x01,
+    BINARY_OP_HOME = 0x02,
+    BINARY_OP_MAGNET = 0x03,
+    BINARY_OP_GOTO = 0x04,
+    BINARY_OP_CLOCK = 0x05,
+} BinaryOpcode;
+
+/* A decoded record, payload points into the frame */
+typedef struct {
+    BinaryOpcode opcode;
+    uint8_t arg;
+    int16_t x;
+    int16_t y;
+    uint8_t speed;
+    uint16_t sequence;
+    const uint8_t *payload;
+} BinaryCommand;
+
+typedef enum {
+    BINARY_DECODE_OK,
+    BINARY_DECODE_END,
+    BINARY_DECODE_ERROR,
+} BinaryDecodeResult;
+
+/*
+ * Whether data holds a binary frame rather than a text script.
+ */
+static inline int isBinaryFrame(const uint8_t *data, size_t length) {
+    return length > 0 && data[0] >= 0x80;
+}
+
+/*
+ * Decode the record at *offset and move *offset past it, starting at 0 for a new frame. Returns
+ * BINARY_DECODE_END after the last record and BINARY_DECODE_ERROR for an unknown version, opcode,
+ * a speed other than 0 or a truncated record, leaving *offset where the problem is.
+ */
+BinaryDecodeResult decodeBinaryCommand(const uint8_t *frame, size_t length, size_t *offset, BinaryCommand *command);
+
+/*
+ * Sequence id of the record at offset, as left by decodeBinaryCommand() on an error, or 0 if the
+ * frame is too short to hold it.
+ */
+uint16_t binaryRecordSequence(const uint8_t *frame, size_t length, size_t offset);
+
+/*
+ * Value of an 8.8 fixed point field.
+ */
+static inline double binaryFixedToDouble(int32_t fixed) {
+    return fixed / 256.0;
+}
+
+#endif //ESP32_BOARDCODE_BINARY_PROTOCOL_H
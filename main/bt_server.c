@@ -5,6 +5,7 @@
  */
 
 #include <esp_gattc_api.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -18,6 +19,8 @@
 #include "esp_bt_main.h"
 #include "bt_server.h"
 #include "esp_gatt_common_api.h"
+#include "sensors.h"
+#include "binary_protocol.h"
 
 #define GATTS_TABLE_TAG "GATTS_TABLE_DEMO"
 
@@ -27,29 +30,47 @@
 #define SAMPLE_DEVICE_NAME          "EE3_CHESS_GAME"
 #define SVC_INST_ID                 0
 
-/* The max length of characteristic value. When the GATT client performs a write or prepare write operation,
-*  the data length must be less than GATTS_DEMO_CHAR_VAL_LEN_MAX.
+/* The max length of characteristic value. When the GATT client performs a write operation,
+*  the data length must be less than GATTS_DEMO_CHAR_VAL_LEN_MAX. Text scripts sent with a long
+*  write have no limit, binary frames are limited to PREPARE_BUF_MAX_SIZE.
 */
 #define GATTS_DEMO_CHAR_VAL_LEN_MAX 500
 #define PREPARE_BUF_MAX_SIZE        1024
 #define CHAR_DECLARATION_SIZE       (sizeof(uint8_t))
 
+// Per square: flips, disagreeing reads in per mille and seconds stable, each a little endian uint16
+#define HEALTH_SQUARE_SIZE          6
+#define HEALTH_VALUE_SIZE           (64 * HEALTH_SQUARE_SIZE)
+#define EVENT_VALUE_SIZE            12
+
 #define ADV_CONFIG_FLAG             (1 << 0)
 #define SCAN_RSP_CONFIG_FLAG        (1 << 1)
 
 esp_gatt_if_t notify_board_gatts_if;
 uint16_t notify_board_conn_id;
+static volatile bool notify_board_enabled = false;
+static volatile bool notify_move_enabled = false;
+static volatile bool notify_event_enabled = false;
+static uint16_t local_mtu = 23;
 
 static uint8_t adv_config_done = 0;
 
 uint16_t chess_handle_table[CHESS_IDX_NB];
 
+/*
+ * Long write to the motor characteristic. Text scripts go to the executor fragment by fragment as
+ * they arrive, binary frames are reassembled first since their records can span fragments.
+ */
 typedef struct {
-    uint8_t *prepare_buf;
-    int prepare_len;
-} prepare_type_env_t;
+    bool active;
+    bool binary;
+    bool failed;  // A fragment was rejected, the rest of the write is ignored
+    uint16_t next_offset;
+    uint8_t frame[PREPARE_BUF_MAX_SIZE];
+} long_write_t;
 
-static prepare_type_env_t prepare_write_env;
+static long_write_t long_write;
+static esp_gatt_rsp_t prepare_rsp;
 
 #define CONFIG_SET_RAW_ADV_DATA
 #ifdef CONFIG_SET_RAW_ADV_DATA
@@ -138,7 +159,11 @@ struct gatts_profile_inst {
     esp_bt_uuid_t descr_uuid;
 };
 
-int executeTextScript(char *script);
+int executeTextScript(const char *script, size_t length);
+int executeBinaryScript(const uint8_t *frame, size_t length);
+void openTextScript();
+void writeTextScript(const char *data, size_t length);
+int closeTextScript(bool cancelled);
 
 
 static void gatts_profile_event_handler(esp_gatts_cb_event_t event,
@@ -156,6 +181,9 @@ static struct gatts_profile_inst chess_profile_tab[PROFILE_NUM] = {
 static const uint16_t GATTS_SERVICE_UUID_TEST = 0x00FF;
 static const uint16_t GATTS_CHAR_UUID_MOTOR = 0xFF01;
 static const uint16_t GATTS_CHAR_UUID_BOARD = 0xFF02;
+static const uint16_t GATTS_CHAR_UUID_MOVE = 0xFF03;
+static const uint16_t GATTS_CHAR_UUID_HEALTH = 0xFF04;
+static const uint16_t GATTS_CHAR_UUID_EVENT = 0xFF05;
 
 
 static const uint16_t primary_service_uuid = ESP_GATT_UUID_PRI_SERVICE;
@@ -163,7 +191,10 @@ static const uint16_t character_declaration_uuid = ESP_GATT_UUID_CHAR_DECLARE;
 static const uint16_t character_client_config_uuid = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
 static const uint8_t char_prop_write = ESP_GATT_CHAR_PROP_BIT_WRITE;
 static const uint8_t char_prop_read_notify = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+static const uint8_t char_prop_read = ESP_GATT_CHAR_PROP_BIT_READ;
 static const uint8_t board_ccc[2] = {0x00, 0x00};
+static const uint8_t move_ccc[2] = {0x00, 0x00};
+static const uint8_t event_ccc[2] = {0x00, 0x00};
 static const uint8_t char_value[4] = {0x11, 0x22, 0x33, 0x44};
 
 
@@ -182,11 +213,11 @@ static const esp_gatts_attr_db_t gatt_db[CHESS_IDX_NB] =
                          {ESP_UUID_LEN_16, (uint8_t *) &character_declaration_uuid, ESP_GATT_PERM_READ,
                                  CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE, (uint8_t *) &char_prop_write}},
 
-                /* Characteristic Value */
+                /* Characteristic Value, answered by the app so long writes reach it fragment by fragment */
                 [IDX_CHAR_VAL_MOTOR] =
-                        {{ESP_GATT_AUTO_RSP},
-                         {ESP_UUID_LEN_16, (uint8_t *) &GATTS_CHAR_UUID_MOTOR, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
-                                 GATTS_DEMO_CHAR_VAL_LEN_MAX, sizeof(char_value), (uint8_t *) char_value}},
+                        {{ESP_GATT_RSP_BY_APP},
+                         {ESP_UUID_LEN_16, (uint8_t *) &GATTS_CHAR_UUID_MOTOR, ESP_GATT_PERM_WRITE,
+                                 GATTS_DEMO_CHAR_VAL_LEN_MAX, 0, NULL}},
 
                 /* Characteristic Declaration */
                 [IDX_CHAR_BOARD]     =
@@ -206,6 +237,56 @@ static const esp_gatts_attr_db_t gatt_db[CHESS_IDX_NB] =
                          {ESP_UUID_LEN_16, (uint8_t *) &character_client_config_uuid,
                                  ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
                                  sizeof(uint16_t), sizeof(board_ccc), (uint8_t *) board_ccc}},
+
+                /* Characteristic Declaration */
+                [IDX_CHAR_MOVE]     =
+                        {{ESP_GATT_AUTO_RSP},
+                         {ESP_UUID_LEN_16, (uint8_t *) &character_declaration_uuid, ESP_GATT_PERM_READ,
+                                 CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE, (uint8_t *) &char_prop_read_notify}},
+
+                /* Characteristic Value */
+                [IDX_CHAR_VAL_MOVE] =
+                        {{ESP_GATT_AUTO_RSP},
+                         {ESP_UUID_LEN_16, (uint8_t *) &GATTS_CHAR_UUID_MOVE, ESP_GATT_PERM_READ,
+                                 GATTS_DEMO_CHAR_VAL_LEN_MAX, 0, NULL}},
+
+                /* Client Characteristic Configuration Descriptor */
+                [IDX_CHAR_CFG_MOVE]  =
+                        {{ESP_GATT_AUTO_RSP},
+                         {ESP_UUID_LEN_16, (uint8_t *) &character_client_config_uuid,
+                                 ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                                 sizeof(uint16_t), sizeof(move_ccc), (uint8_t *) move_ccc}},
+
+                /* Characteristic Declaration */
+                [IDX_CHAR_HEALTH]     =
+                        {{ESP_GATT_AUTO_RSP},
+                         {ESP_UUID_LEN_16, (uint8_t *) &character_declaration_uuid, ESP_GATT_PERM_READ,
+                                 CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE, (uint8_t *) &char_prop_read}},
+
+                /* Characteristic Value, built from the live statistics on every read */
+                [IDX_CHAR_VAL_HEALTH] =
+                        {{ESP_GATT_RSP_BY_APP},
+                         {ESP_UUID_LEN_16, (uint8_t *) &GATTS_CHAR_UUID_HEALTH, ESP_GATT_PERM_READ,
+                                 HEALTH_VALUE_SIZE, 0, NULL}},
+
+                /* Characteristic Declaration */
+                [IDX_CHAR_EVENT]     =
+                        {{ESP_GATT_AUTO_RSP},
+                         {ESP_UUID_LEN_16, (uint8_t *) &character_declaration_uuid, ESP_GATT_PERM_READ,
+                                 CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE, (uint8_t *) &char_prop_read_notify}},
+
+                /* Characteristic Value */
+                [IDX_CHAR_VAL_EVENT] =
+                        {{ESP_GATT_AUTO_RSP},
+                         {ESP_UUID_LEN_16, (uint8_t *) &GATTS_CHAR_UUID_EVENT, ESP_GATT_PERM_READ,
+                                 EVENT_VALUE_SIZE, 0, NULL}},
+
+                /* Client Characteristic Configuration Descriptor */
+                [IDX_CHAR_CFG_EVENT]  =
+                        {{ESP_GATT_AUTO_RSP},
+                         {ESP_UUID_LEN_16, (uint8_t *) &character_client_config_uuid,
+                                 ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                                 sizeof(uint16_t), sizeof(event_ccc), (uint8_t *) event_ccc}},
         };
 
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
@@ -267,52 +348,110 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
     }
 }
 
-void example_prepare_write_event_env(esp_gatt_if_t gatts_if, prepare_type_env_t *prepare_write_env,
-                                     esp_ble_gatts_cb_param_t *param) {
-    ESP_LOGI(GATTS_TABLE_TAG, "prepare write, handle = %d, value len = %d", param->write.handle, param->write.len);
+static void putUint16(uint8_t *value, uint32_t number) {
+    uint16_t saturated = number > UINT16_MAX ? UINT16_MAX : number;
+    value[0] = (uint8_t) saturated;
+    value[1] = (uint8_t) (saturated >> 8);
+}
+
+/*
+ * Answer a read of the health characteristic. Clients read it in MTU sized pieces, each answered
+ * from a fresh snapshot, which is fine for statistics. The buffers would take about 2 KB of the BTC
+ * task stack, they are static as only that task reads.
+ */
+static void sendHealth(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param) {
+    static SquareStats stats[64];
+    static uint8_t value[HEALTH_VALUE_SIZE];
+    static esp_gatt_rsp_t rsp;
+    sensorsGetStats(stats);
+    for (int square = 0; square < 64; square++) {
+        uint8_t *entry = &value[square * HEALTH_SQUARE_SIZE];
+        uint32_t perMille = stats[square].reads ? (uint64_t) stats[square].disagreements * 1000 / stats[square].reads : 0;
+        putUint16(entry, stats[square].flips);
+        putUint16(entry + 2, perMille);
+        putUint16(entry + 4, stats[square].stableMs / 1000);
+    }
+
+    memset(&rsp, 0, sizeof(rsp));
     esp_gatt_status_t status = ESP_GATT_OK;
-    if (prepare_write_env->prepare_buf == NULL) {
-        prepare_write_env->prepare_buf = (uint8_t *) malloc(PREPARE_BUF_MAX_SIZE * sizeof(uint8_t));
-        prepare_write_env->prepare_len = 0;
-        if (prepare_write_env->prepare_buf == NULL) {
-            ESP_LOGE(GATTS_TABLE_TAG, "%s, Gatt_server prep no mem", __func__);
-            status = ESP_GATT_NO_RESOURCES;
-        }
+    rsp.attr_value.handle = param->read.handle;
+    rsp.attr_value.offset = param->read.offset;
+    if (param->read.offset > sizeof(value)) {
+        status = ESP_GATT_INVALID_OFFSET;
     } else {
-        if (param->write.offset > PREPARE_BUF_MAX_SIZE) {
-            status = ESP_GATT_INVALID_OFFSET;
-        } else if ((param->write.offset + param->write.len) > PREPARE_BUF_MAX_SIZE) {
-            status = ESP_GATT_INVALID_ATTR_LEN;
+        rsp.attr_value.len = MIN(sizeof(value) - param->read.offset, local_mtu - 1);
+        memcpy(rsp.attr_value.value, value + param->read.offset, rsp.attr_value.len);
+    }
+    esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id, status, &rsp);
+}
+
+/*
+ * Take one prepared write fragment of the motor characteristic. Fragments must arrive in order,
+ * which every client sending a long write does.
+ */
+static void prepare_motor_write(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param) {
+    ESP_LOGI(GATTS_TABLE_TAG, "prepare write, handle = %d, offset = %d, value len = %d", param->write.handle,
+             param->write.offset, param->write.len);
+    esp_gatt_status_t status = ESP_GATT_OK;
+    if (!long_write.active) {
+        long_write.active = true;
+        long_write.binary = isBinaryFrame(param->write.value, param->write.len);
+        long_write.failed = false;
+        long_write.next_offset = 0;
+        if (!long_write.binary) {
+            openTextScript();
         }
     }
-    /*send response when param->write.need_rsp is true */
-    if (param->write.need_rsp) {
-        esp_gatt_rsp_t *gatt_rsp = (esp_gatt_rsp_t *) malloc(sizeof(esp_gatt_rsp_t));
-        if (gatt_rsp != NULL) {
-            gatt_rsp->attr_value.len = param->write.len;
-            gatt_rsp->attr_value.handle = param->write.handle;
-            gatt_rsp->attr_value.offset = param->write.offset;
-            gatt_rsp->attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
-            memcpy(gatt_rsp->attr_value.value, param->write.value, param->write.len);
-            esp_err_t response_err = esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id,
-                                                                 status, gatt_rsp);
-            if (response_err != ESP_OK) {
-                ESP_LOGE(GATTS_TABLE_TAG, "Send response error");
-            }
-            free(gatt_rsp);
+
+    if (long_write.failed) {
+        status = ESP_GATT_PREPARE_Q_FULL;
+    } else if (param->write.offset != long_write.next_offset) {
+        status = ESP_GATT_INVALID_OFFSET;
+    } else if (long_write.binary && param->write.offset + param->write.len > sizeof(long_write.frame)) {
+        status = ESP_GATT_PREPARE_Q_FULL;
+    }
+
+    if (status == ESP_GATT_OK) {
+        if (long_write.binary) {
+            memcpy(long_write.frame + param->write.offset, param->write.value, param->write.len);
         } else {
-            ESP_LOGE(GATTS_TABLE_TAG, "%s, malloc failed", __func__);
-            status = ESP_GATT_NO_RESOURCES;
+            writeTextScript((const char *) param->write.value, param->write.len);
         }
+        long_write.next_offset += param->write.len;
+    } else {
+        ESP_LOGW(GATTS_TABLE_TAG, "prepare write rejected, status = 0x%x", status);
+        long_write.failed = true;
     }
-    if (status != ESP_GATT_OK) {
-        return;
+
+    /* A prepare write response echoes the fragment so the client can check it */
+    if (param->write.need_rsp) {
+        prepare_rsp.attr_value.len = param->write.len;
+        prepare_rsp.attr_value.handle = param->write.handle;
+        prepare_rsp.attr_value.offset = param->write.offset;
+        prepare_rsp.attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
+        memcpy(prepare_rsp.attr_value.value, param->write.value, param->write.len);
+        if (esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status,
+                                        &prepare_rsp) != ESP_OK) {
+            ESP_LOGE(GATTS_TABLE_TAG, "Send response error");
+        }
     }
-    memcpy(prepare_write_env->prepare_buf + param->write.offset,
-           param->write.value,
-           param->write.len);
-    prepare_write_env->prepare_len += param->write.len;
+}
 
+/*
+ * End of a long write, run what was prepared unless the client cancelled it. Text already
+ * submitted while the fragments arrived can't be taken back, only its last partial command.
+ */
+static void exec_motor_write(esp_ble_gatts_cb_param_t *param) {
+    if (!long_write.active) {
+        return;
+    }
+    bool cancelled = param->exec_write.exec_write_flag != ESP_GATT_PREP_WRITE_EXEC || long_write.failed;
+    if (!long_write.binary) {
+        closeTextScript(cancelled);
+    } else if (!cancelled) {
+        executeBinaryScript(long_write.frame, long_write.next_offset);
+    }
+    long_write.active = false;
 }
 
 static void
@@ -356,6 +495,9 @@ gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
             break;
         case ESP_GATTS_READ_EVT:
             ESP_LOGI(GATTS_TABLE_TAG, "ESP_GATTS_READ_EVT");
+            if (param->read.need_rsp && chess_handle_table[IDX_CHAR_VAL_HEALTH] == param->read.handle) {
+                sendHealth(gatts_if, param);
+            }
             break;
 
         case ESP_GATTS_WRITE_EVT:
@@ -365,29 +507,39 @@ gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
                          param->write.len);
                         esp_log_buffer_hex(GATTS_TABLE_TAG, param->write.value, param->write.len);
 
-                if (chess_handle_table[IDX_CHAR_VAL_MOTOR] == param->write.handle) {
-
-                    char receivedScript[param->write.len + 1];
-                    memcpy(receivedScript, param->write.value, param->write.len);
-                    receivedScript[param->write.len] = '\0';
-                    executeTextScript(receivedScript);
-
-//                    executeTextScript(param->write.value, param->write.len - 0);
+                if (chess_handle_table[IDX_CHAR_VAL_MOTOR] == param->write.handle
+                    && isBinaryFrame(param->write.value, param->write.len)) {
+                    executeBinaryScript(param->write.value, param->write.len);
+                } else if (chess_handle_table[IDX_CHAR_VAL_MOTOR] == param->write.handle) {
+                    executeTextScript((const char *) param->write.value, param->write.len);
                 } else if (chess_handle_table[IDX_CHAR_CFG_BOARD] == param->write.handle && param->write.len == 2) {
                     uint16_t descr_value = param->write.value[1] << 8 | param->write.value[0];
                     if (descr_value == 0x0001) {
                         ESP_LOGI(GATTS_TABLE_TAG, "notify enable");
                         notify_board_gatts_if = gatts_if;
                         notify_board_conn_id = param->write.conn_id;
+                        notify_board_enabled = true;
 
                     } else if (descr_value == 0x0000) {
                         ESP_LOGI(GATTS_TABLE_TAG, "notify/indicate disable ");
-                        notify_board_gatts_if = 0;
-                        notify_board_conn_id = 0;
+                        // The move and event notifications share the connection, leave them as they are
+                        notify_board_enabled = false;
                     } else {
                         ESP_LOGE(GATTS_TABLE_TAG, "unknown descr value");
                                 esp_log_buffer_hex(GATTS_TABLE_TAG, param->write.value, param->write.len);
                     }
+                } else if (chess_handle_table[IDX_CHAR_CFG_MOVE] == param->write.handle && param->write.len == 2) {
+                    uint16_t descr_value = param->write.value[1] << 8 | param->write.value[0];
+                    ESP_LOGI(GATTS_TABLE_TAG, "move notify %s", descr_value == 0x0001 ? "enable" : "disable");
+                    notify_board_gatts_if = gatts_if;
+                    notify_board_conn_id = param->write.conn_id;
+                    notify_move_enabled = descr_value == 0x0001;
+                } else if (chess_handle_table[IDX_CHAR_CFG_EVENT] == param->write.handle && param->write.len == 2) {
+                    uint16_t descr_value = param->write.value[1] << 8 | param->write.value[0];
+                    ESP_LOGI(GATTS_TABLE_TAG, "event notify %s", descr_value == 0x0001 ? "enable" : "disable");
+                    notify_board_gatts_if = gatts_if;
+                    notify_board_conn_id = param->write.conn_id;
+                    notify_event_enabled = descr_value == 0x0001;
                 } else {
                     ESP_LOGI(GATTS_TABLE_TAG, "Write to unsupported characteristic");
                 }
@@ -400,9 +552,20 @@ gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
                 }
             } else {
                 /* handle prepare write */
-                example_prepare_write_event_env(gatts_if, &prepare_write_env, param);
+                if (chess_handle_table[IDX_CHAR_VAL_MOTOR] == param->write.handle) {
+                    prepare_motor_write(gatts_if, param);
+                } else if (param->write.need_rsp) {
+                    esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id,
+                                                ESP_GATT_REQ_NOT_SUPPORTED, NULL);
+                }
             }
             break;
+        case ESP_GATTS_EXEC_WRITE_EVT:
+            ESP_LOGI(GATTS_TABLE_TAG, "ESP_GATTS_EXEC_WRITE_EVT");
+            exec_motor_write(param);
+            esp_ble_gatts_send_response(gatts_if, param->exec_write.conn_id, param->exec_write.trans_id, ESP_GATT_OK,
+                                        NULL);
+            break;
         case ESP_GATTS_CONNECT_EVT:
             ESP_LOGI(GATTS_TABLE_TAG, "ESP_GATTS_CONNECT_EVT, conn_id = %d", param->connect.conn_id);
                     esp_log_buffer_hex(GATTS_TABLE_TAG, param->connect.remote_bda, 6);
@@ -418,6 +581,18 @@ gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
             break;
         case ESP_GATTS_DISCONNECT_EVT:
             ESP_LOGI(GATTS_TABLE_TAG, "ESP_GATTS_DISCONNECT_EVT, reason = 0x%x", param->disconnect.reason);
+            notify_board_enabled = false;
+            notify_move_enabled = false;
+            notify_event_enabled = false;
+            notify_board_gatts_if = 0;
+            notify_board_conn_id = 0;
+            if (long_write.active) {
+                // The client went away in the middle of a long write, drop what it prepared
+                if (!long_write.binary) {
+                    closeTextScript(true);
+                }
+                long_write.active = false;
+            }
             esp_ble_gap_start_advertising(&adv_params);
             break;
         case ESP_GATTS_CREAT_ATTR_TAB_EVT: {
@@ -436,6 +611,7 @@ gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
         }
         case ESP_GATTS_MTU_EVT: {
             uint16_t negotiated_mtu = param->mtu.mtu;
+            local_mtu = negotiated_mtu;
 
             // Update the MTU size if it's smaller than the maximum supported MTU
             if (negotiated_mtu < 518) {
@@ -475,17 +651,47 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
     } while (0);
 }
 
-void notifyBoard(uint64_t board) {
-    // Convert the pointer to uint64_t array to a pointer to uint8_t
-    uint8_t board_ptr[8];
+void notifyBoard(uint64_t board, uint64_t changed) {
+    uint8_t board_value[16];
     for (int i = 0; i < 8; ++i) {
-        printf("0x%" PRIx8 "\n", (uint8_t) (board >> i * 8));
-        board_ptr[i] = (uint8_t) (board >> i * 8);
+        board_value[i] = (uint8_t) (board >> i * 8);
+        board_value[8 + i] = (uint8_t) (changed >> i * 8);
+    }
+    // Keeps reads of the characteristic current as well
+    esp_ble_gatts_set_attr_value(chess_handle_table[IDX_CHAR_VAL_BOARD], sizeof(board_value), board_value);
+    if (!notify_board_enabled) {
+        return;
     }
     //the size of notify_data[] need less than MTU size
     esp_ble_gatts_send_indicate(notify_board_gatts_if, notify_board_conn_id, chess_handle_table[IDX_CHAR_VAL_BOARD],
-                                sizeof(board_ptr), board_ptr, false);
+                                sizeof(board_value), board_value, false);
+}
+
+void notifyMove(const char *move) {
+    esp_ble_gatts_set_attr_value(chess_handle_table[IDX_CHAR_VAL_MOVE], strlen(move), (const uint8_t *) move);
+    if (!notify_move_enabled) {
+        return;
+    }
+    esp_ble_gatts_send_indicate(notify_board_gatts_if, notify_board_conn_id, chess_handle_table[IDX_CHAR_VAL_MOVE],
+                                strlen(move), (uint8_t *) move, false);
+}
 
+void notifyCommandEvent(const CommandEvent *event) {
+    uint32_t duration = event->durationUs > UINT32_MAX ? UINT32_MAX : (uint32_t) event->durationUs;
+    uint8_t event_value[EVENT_VALUE_SIZE] = {
+            (uint8_t) event->sequence, (uint8_t) (event->sequence >> 8),
+            (uint8_t) event->type, (uint8_t) event->status,
+    };
+    for (int i = 0; i < 4; ++i) {
+        event_value[4 + i] = (uint8_t) ((uint32_t) event->steps >> i * 8);
+        event_value[8 + i] = (uint8_t) (duration >> i * 8);
+    }
+    esp_ble_gatts_set_attr_value(chess_handle_table[IDX_CHAR_VAL_EVENT], sizeof(event_value), event_value);
+    if (!notify_event_enabled) {
+        return;
+    }
+    esp_ble_gatts_send_indicate(notify_board_gatts_if, notify_board_conn_id, chess_handle_table[IDX_CHAR_VAL_EVENT],
+                                sizeof(event_value), event_value, false);
 }
 
 void startBT() {
@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "executor.h"
+
 
 /* Attributes State Machine */
 enum
@@ -22,10 +24,43 @@ enum
     IDX_CHAR_VAL_BOARD,
     IDX_CHAR_CFG_BOARD,
 
+    IDX_CHAR_MOVE,
+    IDX_CHAR_VAL_MOVE,
+    IDX_CHAR_CFG_MOVE,
+
+    IDX_CHAR_HEALTH,
+    IDX_CHAR_VAL_HEALTH,
+
+    IDX_CHAR_EVENT,
+    IDX_CHAR_VAL_EVENT,
+    IDX_CHAR_CFG_EVENT,
+
     CHESS_IDX_NB,
 };
 
 void startBT();
-void notifyBoard(uint64_t board);
+
+/*
+ * Update the board characteristic and notify the subscribed client, if any. The value is the board
+ * followed by the squares that changed, both little endian with a1 in bit 0.
+ */
+void notifyBoard(uint64_t board, uint64_t changed);
+
+/*
+ * Update the move characteristic and notify the subscribed client, if any, with a text value like
+ * "e2e4,move,1234": the move in UCI notation, its kind and when it was completed in ms since boot.
+ * A move that finishes the one reported before it, castling with the rook first or en passant with
+ * the taken pawn lifted last, ends in ",corrects" and replaces it. "0000,unknown,1234" means the board
+ * matched no move and tracking carries on from the board as it is.
+ * A piece lost from the magnet is reported the same way with its square, e.g. "d4,dropped,1234".
+ */
+void notifyMove(const char *move);
+
+/*
+ * Notify the subscribed client, if any, of a command event. The value is 12 bytes, little endian:
+ * the sequence (uint16), the event and the status (a byte each, as in executor.h), the steps driven
+ * (int32) and the duration in us (uint32, saturating).
+ */
+void notifyCommandEvent(const CommandEvent *event);
 
 #endif //ESP32_BOARDCODE_BT_SERVER_H
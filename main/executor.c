@@ -0,0 +1,244 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "executor.h"
+#include "nrf.h"
+#include "sensors.h"
+
+/*
+ * Single producer, single consumer ring. The producer only writes head and the consumer only
+ * writes tail, each publishing its slot with release ordering, so neither side ever takes a lock.
+ * The indices run freely and are masked on access, which keeps full and empty apart.
+ */
+static ScriptCommand ring[EXECUTOR_RING_LENGTH];
+static atomic_uint_fast32_t ringHead = 0;
+static atomic_uint_fast32_t ringTail = 0;
+static TaskHandle_t executorTaskHandle = NULL;
+static CommandEventCallback commandEvent = NULL;
+static uint16_t nextSequence = 1;  // Only touched by the submitting task
+
+static void reportEvent(uint16_t sequence, CommandEventType type, CommandStatus status, int32_t steps,
+                        int64_t durationUs) {
+    CommandEvent event = {
+            .sequence = sequence,
+            .type = type,
+            .status = status,
+            .steps = steps,
+            .durationUs = durationUs,
+    };
+    if (commandEvent) {
+        commandEvent(&event);
+    }
+}
+
+static uint16_t assignSequence(uint16_t sequence) {
+    if (sequence != 0) {
+        return sequence;
+    }
+    sequence = nextSequence++;
+    if (nextSequence == 0) {
+        nextSequence = 1;
+    }
+    return sequence;
+}
+
+/*
+ * Tracked commands are reported as accepted before the slot is published, as the executor may
+ * start them as soon as it is.
+ */
+static bool ringPush(const ScriptCommand *command, bool tracked) {
+    uint32_t head = atomic_load_explicit(&ringHead, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ringTail, memory_order_acquire);
+    if (head - tail == EXECUTOR_RING_LENGTH) {
+        return false;
+    }
+    ring[head & (EXECUTOR_RING_LENGTH - 1)] = *command;
+    if (tracked) {
+        reportEvent(command->sequence, COMMAND_ACCEPTED, COMMAND_OK, 0, 0);
+    }
+    atomic_store_explicit(&ringHead, head + 1, memory_order_release);
+    return true;
+}
+
+static bool ringPop(ScriptCommand *command) {
+    uint32_t tail = atomic_load_explicit(&ringTail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ringHead, memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+    *command = ring[tail & (EXECUTOR_RING_LENGTH - 1)];
+    atomic_store_explicit(&ringTail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool executorSubmit(ScriptCommand *command, TickType_t timeout) {
+    bool tracked = command->type != SCRIPT_END;
+    if (tracked) {
+        command->sequence = assignSequence(command->sequence);
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    while (!ringPush(command, tracked)) {
+        if (xTaskGetTickCount() - start >= timeout) {
+            if (tracked) {
+                reportEvent(command->sequence, COMMAND_FAILED, COMMAND_BUSY, 0, 0);
+            }
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    xTaskNotifyGive(executorTaskHandle);
+    return true;
+}
+
+uint16_t executorReject(uint16_t sequence) {
+    sequence = assignSequence(sequence);
+    reportEvent(sequence, COMMAND_FAILED, COMMAND_INVALID, 0, 0);
+    return sequence;
+}
+
+/*
+ * The commands behind a motion, passed as its ctx. Coalesced moves are only merged while their
+ * sequences follow each other, so a range covers them all without anything to allocate.
+ */
+static void *sequenceRange(uint16_t first, uint16_t last) {
+    return (void *) (uintptr_t) ((uint32_t) first << 16 | last);
+}
+
+static void reportRange(void *ctx, CommandEventType type, CommandStatus status, int32_t steps, int64_t durationUs) {
+    uint32_t range = (uintptr_t) ctx;
+    for (uint32_t sequence = range >> 16; sequence <= (range & 0xFFFF); sequence++) {
+        reportEvent(sequence, type, status, steps, durationUs);
+    }
+}
+
+static void onMotionStarted(const MotionResult *result, void *ctx) {
+    // A carried piece has to be watched from the first step, the scanner may be backing off
+    if ((result->type == MOTION_MOVE || result->type == MOTION_GOTO) && motionMagnetOn()) {
+        sensorsWakeScanner();
+    }
+    // Commands not queued by the executor have no sequences
+    if (ctx) {
+        reportRange(ctx, COMMAND_STARTED, COMMAND_OK, 0, 0);
+    }
+}
+
+static void onMotionDone(const MotionResult *result, void *ctx) {
+    switch (result->outcome) {
+        case MOTION_COMPLETED:
+            reportRange(ctx, COMMAND_DONE, COMMAND_OK, result->steps, result->durationUs);
+            break;
+        case MOTION_LIMIT_HIT:
+            reportRange(ctx, COMMAND_FAILED, COMMAND_LIMIT_HIT, result->steps, result->durationUs);
+            break;
+        case MOTION_NOT_HOMED:
+            reportRange(ctx, COMMAND_FAILED, COMMAND_NOT_HOMED, result->steps, result->durationUs);
+            break;
+        case MOTION_ABORTED:
+            reportRange(ctx, COMMAND_FAILED, COMMAND_ABORTED, result->steps, result->durationUs);
+            break;
+        case MOTION_OUT_OF_RANGE:
+            reportRange(ctx, COMMAND_FAILED, COMMAND_OUT_OF_RANGE, result->steps, result->durationUs);
+            break;
+    }
+}
+
+/*
+ * Look-ahead between the transports and the motion queue. Consecutive moves in the same direction
+ * are merged and only queued once a different command or the end of the script arrives, so they
+ * run as one continuous ramped move instead of several hard starts and stops.
+ */
+typedef struct {
+    bool pending;
+    Direction dir;
+    double numHalfTiles;
+    uint16_t firstSequence;
+    uint16_t lastSequence;
+} PendingMove;
+
+static void flushPendingMove(PendingMove *move) {
+    if (move->pending) {
+        motionQueueMove(move->dir, move->numHalfTiles, onMotionDone,
+                        sequenceRange(move->firstSequence, move->lastSequence), portMAX_DELAY);
+        move->pending = false;
+    }
+}
+
+static void coalesceMove(PendingMove *move, const ScriptCommand *command) {
+    if (move->pending && move->dir == command->dir && command->sequence == (uint16_t) (move->lastSequence + 1)) {
+        move->numHalfTiles += command->numHalfTiles;
+        move->lastSequence = command->sequence;
+    } else {
+        flushPendingMove(move);
+        move->pending = true;
+        move->dir = command->dir;
+        move->numHalfTiles = command->numHalfTiles;
+        move->firstSequence = command->sequence;
+        move->lastSequence = command->sequence;
+    }
+}
+
+static void runCommand(PendingMove *move, ScriptCommand *command) {
+    if (command->type == SCRIPT_MOVE) {
+        coalesceMove(move, command);
+        return;
+    }
+
+    flushPendingMove(move);
+    void *ctx = sequenceRange(command->sequence, command->sequence);
+    switch (command->type) {
+        case SCRIPT_HOME:
+            printf("Queueing home\n");
+            motionQueueHome(onMotionDone, ctx, portMAX_DELAY);
+            break;
+        case SCRIPT_MAGNET:
+            printf("Queueing toggleMagnet\n");
+            motionQueueMagnet(command->magnetOn, onMotionDone, ctx, portMAX_DELAY);
+            break;
+        case SCRIPT_GOTO:
+            printf("Queueing goto\n");
+            motionQueueGoto(command->xTiles, command->yTiles, onMotionDone, ctx, portMAX_DELAY);
+            break;
+        case SCRIPT_CLOCK: {
+            reportEvent(command->sequence, COMMAND_STARTED, COMMAND_OK, 0, 0);
+            int64_t startUs = esp_timer_get_time();
+            // The clock only switches once the queued moves are physically done
+            motionWaitIdle(portMAX_DELAY);
+            nrf_send(command->clock);
+            // The board's own moves are done, so it is the human's turn now
+            sensorsSetHumanTurn(true);
+            reportEvent(command->sequence, COMMAND_DONE, COMMAND_OK, 0, esp_timer_get_time() - startUs);
+            break;
+        }
+        case SCRIPT_MOVE:
+        case SCRIPT_END:
+            break;
+    }
+}
+
+static void executorTask(void *arg) {
+    PendingMove move = {0};
+    ScriptCommand command;
+
+    while (1) {
+        while (ringPop(&command)) {
+            runCommand(&move, &command);
+        }
+        // Wait for the rest of a script, but don't sit on a coalesced move if it never comes
+        TickType_t wait = move.pending ? pdMS_TO_TICKS(EXECUTOR_FLUSH_MS) : portMAX_DELAY;
+        if (ulTaskNotifyTake(pdTRUE, wait) == 0) {
+            flushPendingMove(&move);
+        }
+    }
+}
+
+void setupExecutor(CommandEventCallback onEvent) {
+    commandEvent = onEvent;
+    motionSetStartCallback(onMotionStarted);
+    xTaskCreatePinnedToCore(executorTask, "executor", EXECUTOR_TASK_STACK_SIZE, NULL, EXECUTOR_TASK_PRIORITY,
+                            &executorTaskHandle, EXECUTOR_TASK_CORE);
+}
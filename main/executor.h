@@ -0,0 +1,92 @@
+#ifndef ESP32_BOARDCODE_EXECUTOR_H
+#define ESP32_BOARDCODE_EXECUTOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "motion.h"
+
+// Parsed commands waiting for the executor, must be a power of two
+#define EXECUTOR_RING_LENGTH 64
+#define EXECUTOR_TASK_CORE 1
+#define EXECUTOR_TASK_PRIORITY 6
+#define EXECUTOR_TASK_STACK_SIZE 3072
+// A coalesced move is queued once nothing else arrives for this long, even without the end of its script
+#define EXECUTOR_FLUSH_MS 50
+#define EXECUTOR_CLOCK_LENGTH 32
+
+typedef enum {
+    SCRIPT_MOVE,
+    SCRIPT_HOME,
+    SCRIPT_MAGNET,
+    SCRIPT_GOTO,
+    SCRIPT_CLOCK,
+    SCRIPT_END,  // Marks the end of a script, queues any move still being coalesced
+} ScriptCommandType;
+
+/* A command parsed by a transport, from either the text or the binary format */
+typedef struct {
+    uint16_t sequence;  // Reported with every event of the command, 0 to have one assigned
+    ScriptCommandType type;
+    Direction dir;
+    bool magnetOn;
+    double numHalfTiles;
+    double xTiles;  // SCRIPT_GOTO target, in tiles from the centre of a1
+    double yTiles;
+    char clock[EXECUTOR_CLOCK_LENGTH + 1];  // SCRIPT_CLOCK message for the clock, zero padded
+} ScriptCommand;
+
+typedef enum {
+    COMMAND_ACCEPTED,  // Taken into the executor ring
+    COMMAND_STARTED,   // Started driving, or for a clock command, waiting for the motion before it
+    COMMAND_DONE,
+    COMMAND_FAILED,
+} CommandEventType;
+
+typedef enum {
+    COMMAND_OK,
+    COMMAND_INVALID,    // Couldn't be parsed
+    COMMAND_BUSY,       // The executor ring stayed full
+    COMMAND_LIMIT_HIT,  // As the motion outcomes
+    COMMAND_NOT_HOMED,
+    COMMAND_ABORTED,
+    COMMAND_OUT_OF_RANGE,
+} CommandStatus;
+
+/*
+ * Progress of one command. Moves coalesced into one motion each get the events of that motion, with
+ * the steps and duration of the whole of it.
+ */
+typedef struct {
+    uint16_t sequence;
+    CommandEventType type;
+    CommandStatus status;
+    int32_t steps;       // Steps driven, for COMMAND_DONE and COMMAND_FAILED
+    int64_t durationUs;  // From COMMAND_STARTED, for COMMAND_DONE and COMMAND_FAILED
+} CommandEvent;
+
+/* Called from the submitting task, the executor or the motion task, must not block for long */
+typedef void (*CommandEventCallback)(const CommandEvent *event);
+
+/*
+ * Start the executor task. Commands are run by this task in the order they were submitted, so the
+ * transports never wait for motion, magnet delays or the clock radio.
+ */
+void setupExecutor(CommandEventCallback onEvent);
+
+/*
+ * Hand a command to the executor. The ring is lock free with a single producer, so only one task
+ * may submit, which holds since the BLE and HTTP transports are never built together. Waits up to
+ * timeout for room and returns false if the ring stayed full. Fills in the sequence if it is 0 and
+ * reports the command as accepted, or failed if it was dropped.
+ */
+bool executorSubmit(ScriptCommand *command, TickType_t timeout);
+
+/*
+ * Report a command that couldn't be parsed as failed, from the submitting task. Returns its
+ * sequence, assigned if 0 was passed.
+ */
+uint16_t executorReject(uint16_t sequence);
+
+#endif //ESP32_BOARDCODE_EXECUTOR_H
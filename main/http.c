@@ -5,6 +5,8 @@
 
 #include <sys/param.h>
 #include "http.h"
+#include "sensors.h"
+#include "text_script.h"
 
 esp_err_t getStatusHandler(httpd_req_t *req)
 {
@@ -14,28 +16,253 @@ esp_err_t getStatusHandler(httpd_req_t *req)
     return ESP_OK;
 }
 
-int executeTextScript(char *script);
+static portMUX_TYPE boardLock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t lastBoard = 0;
+static uint64_t lastChanged = 0;
+static uint32_t boardSequence = 0;
 
-esp_err_t postExecuteHandler(httpd_req_t *req)
+void httpSetBoard(uint64_t board, uint64_t changed)
+{
+    portENTER_CRITICAL(&boardLock);
+    lastBoard = board;
+    lastChanged = changed;
+    boardSequence++;
+    portEXIT_CRITICAL(&boardLock);
+}
+
+esp_err_t getBoardHandler(httpd_req_t *req)
+{
+    portENTER_CRITICAL(&boardLock);
+    uint64_t board = lastBoard;
+    uint64_t changed = lastChanged;
+    uint32_t sequence = boardSequence;
+    portEXIT_CRITICAL(&boardLock);
+
+    char resp[96];
+    snprintf(resp, sizeof(resp), "board: 0x%016" PRIx64 "\nchanged: 0x%016" PRIx64 "\nseq: %" PRIu32,
+             board, changed, sequence);
+    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+static char lastMove[48] = "";
+static uint32_t moveSequence = 0;
+
+void httpSetMove(const char *move)
+{
+    portENTER_CRITICAL(&boardLock);
+    strlcpy(lastMove, move, sizeof(lastMove));
+    moveSequence++;
+    portEXIT_CRITICAL(&boardLock);
+}
+
+esp_err_t getMoveHandler(httpd_req_t *req)
+{
+    char move[sizeof(lastMove)];
+    portENTER_CRITICAL(&boardLock);
+    strlcpy(move, lastMove, sizeof(move));
+    uint32_t sequence = moveSequence;
+    portEXIT_CRITICAL(&boardLock);
+
+    char resp[96];
+    snprintf(resp, sizeof(resp), "move: %s\nseq: %" PRIu32, move, sequence);
+    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+static CommandEvent eventHistory[HTTP_EVENT_HISTORY];
+static uint32_t eventCount = 0;
+
+static const char *const eventNames[] = {"accepted", "started", "done", "failed"};
+static const char *const statusNames[] = {"ok", "invalid", "busy", "limit_hit", "not_homed", "aborted",
+                                             "out_of_range"};
+
+void httpAddCommandEvent(const CommandEvent *event)
+{
+    portENTER_CRITICAL(&boardLock);
+    eventHistory[eventCount % HTTP_EVENT_HISTORY] = *event;
+    eventCount++;
+    portEXIT_CRITICAL(&boardLock);
+}
+
+esp_err_t getEventsHandler(httpd_req_t *req)
+{
+    uint32_t since = 0;
+    char query[32];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+        && httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+        since = strtoul(value, NULL, 10);
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    char line[96];
+    for (;;) {
+        // Copied one at a time so the lock is never held across a send
+        CommandEvent event;
+        portENTER_CRITICAL(&boardLock);
+        uint32_t oldest = eventCount > HTTP_EVENT_HISTORY ? eventCount - HTTP_EVENT_HISTORY : 0;
+        since = MAX(since, oldest);
+        bool more = since < eventCount;
+        if (more) {
+            event = eventHistory[since % HTTP_EVENT_HISTORY];
+        }
+        portEXIT_CRITICAL(&boardLock);
+        if (!more) {
+            break;
+        }
+
+        since++;
+        snprintf(line, sizeof(line), "%" PRIu32 " %u %s %s %" PRId32 " %" PRId64 "\n", since, event.sequence,
+                 eventNames[event.type], statusNames[event.status], event.steps, event.durationUs);
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+esp_err_t getSensorsHandler(httpd_req_t *req)
+{
+    SquareStats stats[64];
+    sensorsGetStats(stats);
+
+    char line[96];
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_sendstr_chunk(req, "square flips reads disagreements stable_ms\n");
+    for (int square = 0; square < 64; square++) {
+        snprintf(line, sizeof(line), "%c%c %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 "\n",
+                 'a' + square % 8, '1' + square / 8, stats[square].flips, stats[square].reads,
+                 stats[square].disagreements, stats[square].stableMs);
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+int executeTextScriptStream(TextScriptReader read, void *ctx);
+
+typedef struct {
+    httpd_req_t *req;
+    size_t remaining;
+    bool retried;
+    int error;
+} BodyReader;
+
+static int readBody(char *buffer, size_t size, void *ctx)
 {
-    char content[100];
-    size_t recv_size = MIN(req->content_len, sizeof(content));
+    BodyReader *reader = ctx;
+    if (reader->remaining == 0) {
+        return 0;
+    }
 
-    int ret = httpd_req_recv(req, content, recv_size);
+    int ret = httpd_req_recv(reader->req, buffer, MIN(reader->remaining, size));
+    if (ret == HTTPD_SOCK_ERR_TIMEOUT && !reader->retried) {
+        // A slow client gets one more chance before the request is given up on
+        reader->retried = true;
+        ret = httpd_req_recv(reader->req, buffer, MIN(reader->remaining, size));
+    }
     if (ret <= 0) {  /* 0 return value indicates connection closed */
-        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+        reader->error = ret;
+        return -1;
+    }
+    reader->remaining -= ret;
+    return ret;
+}
+
+esp_err_t postExecuteHandler(httpd_req_t *req)
+{
+    // The body is parsed as it arrives, so scripts of any length run without buffering them
+    BodyReader reader = {.req = req, .remaining = req->content_len};
+    int dropped = executeTextScriptStream(readBody, &reader);
+    if (dropped < 0) {
+        if (reader.error == HTTPD_SOCK_ERR_TIMEOUT) {
             httpd_resp_send_408(req);
         }
         return ESP_FAIL;
     }
-
-    executeTextScript(content);
+    if (dropped > 0) {
+        // The commands that fitted in the executor still run, tell the client how many did not
+        char resp[32];
+        snprintf(resp, sizeof(resp), "dropped: %d", dropped);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, resp);
+        return ESP_OK;
+    }
 
     const char resp[] = "URI POST Response";
     httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
+/*
+ * Install a sensor map: the body lists the square (a1 = 0) behind every mux output in clock order,
+ * 64 numbers separated by commas or whitespace, and ?invert= the hex bitboard of sensors that read
+ * low when empty.
+ */
+esp_err_t postSensorMapHandler(httpd_req_t *req)
+{
+    char body[HTTP_SENSOR_MAP_MAX_BODY + 1];
+    if (req->content_len > HTTP_SENSOR_MAP_MAX_BODY) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Map too long");
+        return ESP_OK;
+    }
+    BodyReader reader = {.req = req, .remaining = req->content_len};
+    size_t length = 0;
+    int ret;
+    while ((ret = readBody(body + length, HTTP_SENSOR_MAP_MAX_BODY - length, &reader)) > 0) {
+        length += ret;
+    }
+    if (ret < 0) {
+        if (reader.error == HTTPD_SOCK_ERR_TIMEOUT) {
+            httpd_resp_send_408(req);
+        }
+        return ESP_FAIL;
+    }
+    body[length] = '\0';
+
+    uint8_t map[64];
+    int count = 0;
+    char *next = body;
+    for (;;) {
+        next += strspn(next, ", \t\r\n");
+        if (*next == '\0' || count == 64) {
+            break;
+        }
+        char *end;
+        unsigned long square = strtoul(next, &end, 10);
+        if (end == next || square > 63) {
+            break;
+        }
+        map[count++] = square;
+        next = end;
+    }
+
+    uint64_t inverted = 0;
+    char query[40];
+    char value[20];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+        && httpd_query_key_value(query, "invert", value, sizeof(value)) == ESP_OK) {
+        inverted = strtoull(value, NULL, 16);
+    }
+
+    if (count != 64 || *next != '\0' || !sensorsSetMap(map, inverted)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected the 64 squares a1 = 0 to h8 = 63, each once");
+        return ESP_OK;
+    }
+    httpd_resp_sendstr(req, "map: stored");
+    return ESP_OK;
+}
+
+/*
+ * Calibrate the sensor settle time, see sensorsCalibrate(). The board must not be touched until the
+ * response arrives.
+ */
+esp_err_t postSensorCalibrateHandler(httpd_req_t *req)
+{
+    char resp[32];
+    snprintf(resp, sizeof(resp), "settle_us: %" PRIu32, sensorsCalibrate());
+    httpd_resp_sendstr(req, resp);
+    return ESP_OK;
+}
+
 httpd_uri_t execute_get = {
         .uri      = "/execute",
         .method   = HTTP_POST,
@@ -43,6 +270,48 @@ httpd_uri_t execute_get = {
         .user_ctx = NULL
 };
 
+httpd_uri_t board_get = {
+        .uri      = "/board",
+        .method   = HTTP_GET,
+        .handler  = getBoardHandler,
+        .user_ctx = NULL
+};
+
+httpd_uri_t move_get = {
+        .uri      = "/move",
+        .method   = HTTP_GET,
+        .handler  = getMoveHandler,
+        .user_ctx = NULL
+};
+
+httpd_uri_t sensors_get = {
+        .uri      = "/sensors",
+        .method   = HTTP_GET,
+        .handler  = getSensorsHandler,
+        .user_ctx = NULL
+};
+
+httpd_uri_t events_get = {
+        .uri      = "/events",
+        .method   = HTTP_GET,
+        .handler  = getEventsHandler,
+        .user_ctx = NULL
+};
+
+httpd_uri_t sensor_map_post = {
+        .uri      = "/sensors/map",
+        .method   = HTTP_POST,
+        .handler  = postSensorMapHandler,
+        .user_ctx = NULL
+};
+
+httpd_uri_t sensor_calibrate_post = {
+        .uri      = "/sensors/calibrate",
+        .method   = HTTP_POST,
+        .handler  = postSensorCalibrateHandler,
+        .user_ctx = NULL
+};
+
 httpd_uri_t status_get = {
         .uri      = "/status",
         .method   = HTTP_GET,
@@ -59,6 +328,12 @@ httpd_handle_t startWebserver(void)
         /* Register URI handlers */
         httpd_register_uri_handler(server, &status_get);
         httpd_register_uri_handler(server, &execute_get);
+        httpd_register_uri_handler(server, &board_get);
+        httpd_register_uri_handler(server, &move_get);
+        httpd_register_uri_handler(server, &sensors_get);
+        httpd_register_uri_handler(server, &events_get);
+        httpd_register_uri_handler(server, &sensor_map_post);
+        httpd_register_uri_handler(server, &sensor_calibrate_post);
 
     }
     return server;
@@ -20,11 +20,36 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "executor.h"
+
 #define TAG_HTTP "HTTP"
+// Command events kept for GET /events
+#define HTTP_EVENT_HISTORY 32
+// Longest body POST /sensors/map takes, 64 squares of up to 2 digits with separators need 192
+#define HTTP_SENSOR_MAP_MAX_BODY 512
 
 httpd_handle_t startWebserver();
 
 void processPostContent(const char* content);
 
+/*
+ * Latest board served on GET /board, along with the squares that changed and a counter clients can
+ * compare to see whether anything happened since their last request.
+ */
+void httpSetBoard(uint64_t board, uint64_t changed);
+
+/*
+ * Latest move served on GET /move, in the same format as the BLE move characteristic, followed by
+ * a counter of the moves seen so far.
+ */
+void httpSetMove(const char *move);
+
+/*
+ * Record a command event for GET /events. Each event is numbered, and GET /events?since=N returns
+ * the ones after N still in the history, one per line as "number sequence event status steps
+ * duration_us".
+ */
+void httpAddCommandEvent(const CommandEvent *event);
+
 
 #endif //ESP32_BOARDCODE_HTTP_H
@@ -4,27 +4,23 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "driver/gpio.h"
-#include "driver/rmt_tx.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "include/soc/gpio_sig_map.h"
-#include "math.h"
-#include "rom/gpio.h"
-#include "stepper_motor_encoder.h"
+#include "esp_timer.h"
+#include "binary_protocol.h"
+#include "executor.h"
+#include "motion.h"
+#include "move_tracker.h"
 #include "nrf.h"
-
-#define MUX_RST GPIO_NUM_8
-#define MUX_CLK GPIO_NUM_18
-#define GPIO_OUTPUT_MUX_SEL ((1ULL << MUX_RST) | (1ULL << MUX_CLK))
-
-#define SENSOR_ARRAY GPIO_NUM_17
-// #define GPIO_INPUT_PIN_SEL  (1ULL<<SENSOR_ARRAY)
+#include "sensors.h"
+#include "text_script.h"
 
 //#define USE_WIFI
 #define USE_BLUETOOTH
@@ -43,414 +39,273 @@
 #error "Please define either USE_WIFI or USE_BLUETOOTH"
 #endif
 
-#define STEP_MOTOR_GPIO_STEP1 GPIO_NUM_37
-#define STEP_MOTOR_GPIO_STEP2 GPIO_NUM_47
-
-#define STEP_MOTOR_SLP1 GPIO_NUM_36
-#define STEP_MOTOR_DIR1 GPIO_NUM_38
-#define STEP_MOTOR_RST1 GPIO_NUM_35
-
-#define STEP_MOTOR_SLP2 GPIO_NUM_21
-#define STEP_MOTOR_DIR2 GPIO_NUM_48
-#define STEP_MOTOR_RST2 GPIO_NUM_45
-
-#define EM_TOGGLE GPIO_NUM_1
-
-#define GPIO_OUTPUT_RMT_SEL \
-    ((1ULL << STEP_MOTOR_GPIO_STEP1) | (1ULL << STEP_MOTOR_GPIO_STEP2))
-
-#define GPIO_OUTPUT_PIN_SEL (((1ULL << STEP_MOTOR_DIR1) | (1ULL << STEP_MOTOR_SLP1) | (1ULL << STEP_MOTOR_RST1) | (1ULL << STEP_MOTOR_DIR2) | (1ULL << STEP_MOTOR_SLP2) | (1ULL << STEP_MOTOR_RST2) | (1ULL << EM_TOGGLE)) | (GPIO_OUTPUT_RMT_SEL))
-
-#define EMERGENCY_OUTER GPIO_NUM_16
-#define EMERGENCY_INNER GPIO_NUM_15
-
-#define GPIO_INPUT_PIN_SEL \
-    ((1ULL << EMERGENCY_OUTER) | (1ULL << EMERGENCY_INNER))
-
-#define ORTHOGONAL_TILE_IN_STEPS 5860
-#define DIAGONAL_TILE_IN_STEPS 15913
-
-#define STEP_MOTOR_RESOLUTION_HZ 2000000  // 1MHz resolution
-#define TAG_RMT "RMT"
-
-const static uint32_t uniform_speed_hz = 25000;
-
 #define MAX_COMMANDS 10
 #define MOVE_HEADER_LENGTH 32
 #define MAX_PARAMS 10
 #define MAX_PARAM_LENGTH 10
-
-typedef enum {
-    NO = 0,
-    SO = 1,
-    WE = 2,
-    EA = 3,
-
-    NE = 4,
-    NW = 5,
-    SW = 6,
-    SE = 7
-} Direction;
-
-static const int dirConfigs[8][4] = {{1, 1, 1, 1},   // NO
-                                     {0, 0, 1, 1},   // SO
-                                     {0, 1, 1, 1},   // WE
-                                     {1, 0, 1, 1},   // EA
-                                     {1, 0, 1, 0},   // NE
-                                     {0, 1, 0, 1},   // NW
-                                     {0, 0, 1, 0},   // SW
-                                     {0, 0, 0, 1}};  // SE
-
-const uint8_t positions[] = {
-        49,
-        51,
-        55,
-        53,
-        57,
-        59,
-        61,
-        63,
-        64,
-        62,
-        60,
-        58,
-        56,
-        54,
-        52,
-        50,
-        33,
-        35,
-        37,
-        39,
-        41,
-        43,
-        45,
-        47,
-        48,
-        46,
-        44,
-        42,
-        40,
-        38,
-        36,
-        34,
-        17,
-        19,
-        21,
-        23,
-        25,
-        27,
-        29,
-        31,
-        32,
-        30,
-        28,
-        26,
-        24,
-        22,
-        20,
-        18,
-        1,
-        3,
-        5,
-        7,
-        9,
-        11,
-        13,
-        15,
-        16,
-        14,
-        12,
-        10,
-        8,
-        6,
-        4,
-        2
-
-};
-
-rmt_channel_handle_t motor_chan = NULL;
-rmt_encoder_handle_t uniform_motor_encoder = NULL;
-
-Direction extractDirection(const char *moveCommand) {
-    if (strncmp(moveCommand + 2, "NO", 2) == 0) {
-        return NO;
-    } else if (strncmp(moveCommand + 2, "SO", 2) == 0) {
-        return SO;
-    } else if (strncmp(moveCommand + 2, "WE", 2) == 0) {
-        return WE;
-    } else if (strncmp(moveCommand + 2, "EA", 2) == 0) {
-        return EA;
-    } else if (strncmp(moveCommand + 2, "NE", 2) == 0) {
-        return NE;
-    } else if (strncmp(moveCommand + 2, "NW", 2) == 0) {
-        return NW;
-    } else if (strncmp(moveCommand + 2, "SW", 2) == 0) {
-        return SW;
-    } else {
-        return SE;
+// Streamed HTTP scripts may wait this long for room in the executor ring before commands are dropped
+#define SCRIPT_STREAM_SUBMIT_TIMEOUT_MS 1000
+
+/* Where the commands of a script go, shared by the tokenizer callback and its caller */
+typedef struct {
+    TickType_t timeout;
+    int dropped;
+} ScriptSubmission;
+
+static void submitCommand(ScriptSubmission *submission, ScriptCommand *command) {
+    if (!executorSubmit(command, submission->timeout)) {
+        submission->dropped++;
     }
 }
 
-int extractDistance(const char *moveCommand) {
-    return atoi(moveCommand + 4);
+static void finishScript(ScriptSubmission *submission) {
+    ScriptCommand end = {.type = SCRIPT_END};
+    submitCommand(submission, &end);
+    if (submission->dropped > 0) {
+        printf("Executor busy, dropped %d commands\n", submission->dropped);
+    }
 }
 
-void disableMotor1() {
-    gpio_set_level(STEP_MOTOR_RST1, 0);
-    gpio_set_level(STEP_MOTOR_SLP1, 1);
+static void onTextCommand(char *command, void *ctx) {
+    ScriptCommand parsed;
+    if (command && parseTextCommand(command, &parsed)) {
+        submitCommand(ctx, &parsed);
+    } else {
+        executorReject(0);
+    }
 }
 
-void disableMotor2() {
-    gpio_set_level(STEP_MOTOR_RST2, 0);
-    gpio_set_level(STEP_MOTOR_SLP2, 1);
+/*
+ * Hand a script to the executor and return without waiting for it to run. Called from the
+ * Bluetooth task, so commands that don't fit in the executor ring are dropped rather than waited
+ * for. Returns 1 if anything was dropped.
+ */
+int executeTextScript(const char *script, size_t length) {
+    ScriptSubmission submission = {.timeout = 0};
+    TextScriptTokenizer tokenizer;
+    textScriptInit(&tokenizer, onTextCommand, &submission);
+
+    printf("Executing script\n");
+    textScriptFeed(&tokenizer, script, length);
+    textScriptFinish(&tokenizer);
+    finishScript(&submission);
+    return submission.dropped > 0;
 }
 
-void enableMotor1() {
-    gpio_set_level(STEP_MOTOR_RST1, 1);
-    gpio_set_level(STEP_MOTOR_SLP1, 1);
+/*
+ * Hand a script to the executor as it is received, each command is submitted as soon as its
+ * delimiter arrives. Returns how many commands were dropped because the executor stayed full, or -1
+ * if the reader failed, in which case the command it was in the middle of is dropped too.
+ */
+int executeTextScriptStream(TextScriptReader read, void *ctx) {
+    ScriptSubmission submission = {.timeout = pdMS_TO_TICKS(SCRIPT_STREAM_SUBMIT_TIMEOUT_MS)};
+    TextScriptTokenizer tokenizer;
+    char chunk[64];
+    int received;
+    textScriptInit(&tokenizer, onTextCommand, &submission);
+
+    printf("Executing script\n");
+    while ((received = read(chunk, sizeof(chunk), ctx)) > 0) {
+        textScriptFeed(&tokenizer, chunk, received);
+    }
+    if (received == 0) {
+        textScriptFinish(&tokenizer);
+    }
+    finishScript(&submission);
+    return received < 0 ? -1 : submission.dropped;
 }
 
-void enableMotor2() {
-    gpio_set_level(STEP_MOTOR_RST2, 1);
-    gpio_set_level(STEP_MOTOR_SLP2, 1);
+/*
+ * A script pushed to the executor in pieces as a transport receives them, for BLE long writes.
+ * Only one can be open at a time, and only from the Bluetooth task.
+ */
+static TextScriptTokenizer pushedTokenizer;
+static ScriptSubmission pushedSubmission;
+
+void openTextScript() {
+    pushedSubmission = (ScriptSubmission) {.timeout = 0};
+    textScriptInit(&pushedTokenizer, onTextCommand, &pushedSubmission);
+    printf("Executing script\n");
 }
 
-bool isPressed(gpio_num_t input) {
-    return !gpio_get_level(input);
+void writeTextScript(const char *data, size_t length) {
+    textScriptFeed(&pushedTokenizer, data, length);
 }
 
-void toggleMotor(bool switchOn, int motor) {
-    if (motor == 1) {
-        if (switchOn) {
-            enableMotor1();
-        } else {
-            disableMotor1();
-        }
-    } else if (motor == 2) {
-        if (switchOn) {
-            enableMotor2();
-        } else {
-            disableMotor2();
-        }
+/*
+ * Finish the open script. If it was cancelled, the command it was in the middle of is dropped, the
+ * ones already submitted still run. Returns 1 if anything was dropped.
+ */
+int closeTextScript(bool cancelled) {
+    if (!cancelled) {
+        textScriptFinish(&pushedTokenizer);
     }
+    finishScript(&pushedSubmission);
+    return cancelled || pushedSubmission.dropped > 0;
 }
 
-void executeToggleMagnet(uint8_t switchOn) {
-    if (switchOn == '1') {
-        gpio_set_level(EM_TOGGLE, 1);
-        vTaskDelay(200 / portTICK_PERIOD_MS);
-        printf("Magnet state: %d", switchOn);
-    } else if (switchOn == '0') {
-        gpio_set_level(EM_TOGGLE, 0);
-        vTaskDelay(200 / portTICK_PERIOD_MS);
-        printf("Magnet state: %d", switchOn);
-    } else {
-        printf("wrong command in magnet toggle");
-    };
+static void parseBinaryCommand(const BinaryCommand *command, ScriptCommand *parsed) {
+    *parsed = (ScriptCommand) {.sequence = command->sequence};
+    switch (command->opcode) {
+        case BINARY_OP_MOVE:
+            parsed->type = SCRIPT_MOVE;
+            parsed->dir = command->arg;
+            parsed->numHalfTiles = binaryFixedToDouble(command->x);
+            break;
+        case BINARY_OP_HOME:
+            parsed->type = SCRIPT_HOME;
+            break;
+        case BINARY_OP_MAGNET:
+            parsed->type = SCRIPT_MAGNET;
+            parsed->magnetOn = command->arg == 1;
+            break;
+        case BINARY_OP_GOTO:
+            parsed->type = SCRIPT_GOTO;
+            parsed->xTiles = binaryFixedToDouble(command->x);
+            parsed->yTiles = binaryFixedToDouble(command->y);
+            break;
+        case BINARY_OP_CLOCK:
+            // nrf_send always reads a full packet, the rest of the message stays zero
+            parsed->type = SCRIPT_CLOCK;
+            memcpy(parsed->clock, command->payload, command->arg);
+            break;
+    }
 }
 
-bool canMoveto(Direction dir) {
-    switch (dir) {
-        case NO:
-            return true;
-        case SO:
-            if (!isPressed(EMERGENCY_INNER)) {
-                return true;
-            } else
-                return false;
-        case WE:
-            if (!isPressed(EMERGENCY_OUTER)) {
-                return true;
-            } else
-                return false;
-        case EA:
-            return true;
-        case NE:
-            return true;
-        case NW:
-            if (!isPressed(EMERGENCY_OUTER)) {
-                return true;
-            } else
-                return false;
-        case SW:
-            if (!isPressed(EMERGENCY_OUTER) && !isPressed(EMERGENCY_INNER)) {
-                return true;
-            } else
-                return false;
-        case SE:
-            if (!isPressed(EMERGENCY_INNER)) {
-                return true;
-            } else
-                return false;
+/*
+ * Report every record of a malformed frame as failed: the ones before the record at errorOffset and
+ * that record itself. Records after it can't be told apart once its length is in doubt.
+ */
+static void rejectBinaryScript(const uint8_t *frame, size_t length, size_t errorOffset) {
+    BinaryCommand command;
+    size_t offset = 0;
+    while (offset < errorOffset && decodeBinaryCommand(frame, length, &offset, &command) == BINARY_DECODE_OK) {
+        executorReject(command.sequence);
     }
-    return false;
+    executorReject(binaryRecordSequence(frame, length, errorOffset));
 }
 
-int executeMove(Direction dir, double numHalfTiles) {
-    double tileDistance;
-    if (dir > 3) {
-        tileDistance = ((DIAGONAL_TILE_IN_STEPS / 2) * numHalfTiles * 0.75);
-        if (dir % 2 == 0) {
-            gpio_matrix_out(STEP_MOTOR_GPIO_STEP2, SIG_GPIO_OUT_IDX, false, false);
-        } else {
-            gpio_matrix_out(STEP_MOTOR_GPIO_STEP1, SIG_GPIO_OUT_IDX, false, false);
-        }
-    } else {
-        tileDistance = (ORTHOGONAL_TILE_IN_STEPS / 2) * numHalfTiles;
+/*
+ * Hand a binary frame to the executor, see binary_protocol.h. A frame with a malformed record is
+ * rejected as a whole before anything runs. Like executeTextScript(), never waits for room in the
+ * executor ring.
+ */
+int executeBinaryScript(const uint8_t *frame, size_t length) {
+    ScriptSubmission submission = {.timeout = 0};
+    BinaryCommand command;
+    ScriptCommand parsed;
+    size_t offset = 0;
+    BinaryDecodeResult result;
+
+    // Check the whole frame first, half a script would leave the pieces somewhere unexpected
+    while ((result = decodeBinaryCommand(frame, length, &offset, &command)) == BINARY_DECODE_OK) {
     }
-
-    gpio_set_level(STEP_MOTOR_DIR1, dirConfigs[dir][0]);
-    gpio_set_level(STEP_MOTOR_DIR2, dirConfigs[dir][1]);
-    enableMotor1();
-    enableMotor2();
-    // toggleMotor(dirConfigs[dir][2], 1);
-    // toggleMotor(dirConfigs[dir][3], 2);
-    printf("dirConfigs %i : DIR1 = %i, DIR2 = %i, M1  = %i, M2  = %i \n", dir, dirConfigs[dir][0],
-           dirConfigs[dir][1], dirConfigs[dir][2], dirConfigs[dir][3]);
-
-    if (canMoveto(dir)) {
-        rmt_transmit_config_t tx_config = {
-            .loop_count = tileDistance,
-        };
-
-        // uniform phase
-        ESP_ERROR_CHECK(rmt_transmit(motor_chan, uniform_motor_encoder,
-                                     &uniform_speed_hz, sizeof(uniform_speed_hz), &tx_config));
-
-        // wait all transactions finished
-        ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+    if (result == BINARY_DECODE_ERROR) {
+        printf("Malformed binary script at byte %u\n", (unsigned) offset);
+        rejectBinaryScript(frame, length, offset);
+        return 1;
     }
 
-    disableMotor1();
-    disableMotor2();
-
-    gpio_matrix_out(STEP_MOTOR_GPIO_STEP1, RMT_SIG_OUT0_IDX, false, false);
-    gpio_matrix_out(STEP_MOTOR_GPIO_STEP2, RMT_SIG_OUT0_IDX, false, false);
-
-    return tileDistance;
-}
-
-void executeHome() {
-    if (!isPressed(EMERGENCY_INNER) || !isPressed(EMERGENCY_OUTER)) {
-        printf("IN GET HOME\n");
-        while (!isPressed(EMERGENCY_INNER)) {
-            executeMove(SO, .25);
-        }
-        while (!isPressed(EMERGENCY_OUTER)) {
-            executeMove(WE, .25);
-        }
+    printf("Executing binary script\n");
+    offset = 0;
+    while (decodeBinaryCommand(frame, length, &offset, &command) == BINARY_DECODE_OK) {
+        parseBinaryCommand(&command, &parsed);
+        submitCommand(&submission, &parsed);
     }
-    printf("HOME");
+    finishScript(&submission);
+    return submission.dropped > 0;
 }
 
-void setupRMT() {
-    ESP_LOGI(TAG_RMT, "Create RMT TX channel");
-    rmt_tx_channel_config_t tx_chan_config = {
-            .clk_src = RMT_CLK_SRC_DEFAULT,  // select clock source
-            .gpio_num = STEP_MOTOR_GPIO_STEP1,
-            .mem_block_symbols = 64,
-            .resolution_hz = STEP_MOTOR_RESOLUTION_HZ,
-            .trans_queue_depth = 10,  // set the number of transactions that can be pending in the background
-    };
-    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &motor_chan));
-
-    // SIG_GPIO_OUT_IDX
-    gpio_matrix_out(STEP_MOTOR_GPIO_STEP2, RMT_SIG_OUT0_IDX, false, false);
-
-    stepper_motor_uniform_encoder_config_t uniform_encoder_config = {
-            .resolution = STEP_MOTOR_RESOLUTION_HZ,
-    };
+static MoveTracker moveTracker;
+// The scanner updates the tracker and the hold timer releases from it, from different tasks
+static portMUX_TYPE moveTrackerLock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t moveTrackerTimer = NULL;
+
+static void publishMove(const BoardMove *move) {
+    char uci[MOVE_STRING_LENGTH];
+    char value[48];
+    moveToString(move, uci);
+    snprintf(value, sizeof(value), "%s,%s,%" PRId64 "%s", uci, moveKindName(move->kind), move->timestampUs / 1000,
+             move->corrects ? ",corrects" : "");
+    printf("Move %s\n", value);
+#ifdef USE_WIFI
+    httpSetMove(value);
+#elif defined(USE_BLUETOOTH)
+    notifyMove(value);
+#endif
+}
 
-    ESP_ERROR_CHECK(rmt_new_stepper_motor_uniform_encoder(&uniform_encoder_config, &uniform_motor_encoder));
+static void publishCarryLost(uint64_t squares) {
+    char value[48];
+    int square = __builtin_ctzll(squares);
+    snprintf(value, sizeof(value), "%c%c,dropped,%" PRId64, 'a' + square % 8, '1' + square / 8,
+             esp_timer_get_time() / 1000);
+    printf("Piece lost %s\n", value);
+#ifdef USE_WIFI
+    httpSetMove(value);
+#elif defined(USE_BLUETOOTH)
+    notifyMove(value);
+#endif
+}
 
-    ESP_LOGI(TAG_RMT, "Enable RMT channel");
-    ESP_ERROR_CHECK(rmt_enable(motor_chan));
+static void publishCommandEvent(const CommandEvent *event) {
+    ESP_LOGD("executor", "Command %u event %d status %d, %" PRId32 " steps in %" PRId64 " us", event->sequence,
+             event->type, event->status, event->steps, event->durationUs);
+#ifdef USE_WIFI
+    httpAddCommandEvent(event);
+#elif defined(USE_BLUETOOTH)
+    notifyCommandEvent(event);
+#endif
 }
 
-uint64_t readSensors() {
-    uint64_t board[2] = {0};
-    // Equivalent to loop()
-    vTaskDelay(50 / portTICK_PERIOD_MS);
-    gpio_set_level(MUX_CLK, 0);
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-    gpio_set_level(MUX_CLK, 1);
-
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-    gpio_set_level(MUX_RST, 1);
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-    gpio_set_level(MUX_RST, 0);
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-
-    // Wait 1s
-    for (int j = 0; j < 2; ++j) {
-        for (int i = 0; i < 64; i++) {
-            if (!gpio_get_level(SENSOR_ARRAY)) {
-                board[j] = board[j] | ((uint64_t)!gpio_get_level(SENSOR_ARRAY) << (positions[i] - 1));
-                vTaskDelay(150 / portTICK_PERIOD_MS);
-            }
-            gpio_set_level(MUX_CLK, 0);
-            // Delay 50 ms
-            vTaskDelay(15 / portTICK_PERIOD_MS);
-            // Set HIGH
-            gpio_set_level(MUX_CLK, 1);
-            vTaskDelay(15 / portTICK_PERIOD_MS);
-        }
-    }
-    printf("0x%" PRIx64 "\n", board[0]);
-    if (board[1] == board[0]) {
-        return board[0];
-    } else {
-        return readSensors();
+/* Wake up when the tracker may have something to release, if ever */
+static void scheduleMoveTracker(int64_t deadlineUs) {
+    esp_timer_stop(moveTrackerTimer);
+    if (deadlineUs >= 0) {
+        int64_t delayUs = deadlineUs - esp_timer_get_time();
+        ESP_ERROR_CHECK(esp_timer_start_once(moveTrackerTimer, delayUs > 0 ? delayUs : 1));
     }
 }
 
-int executeTextCommand(char *command) {
-    if (strncmp(command, "MV", 2) == 0) {
-        // eg. "MVNE7"
-        printf("Executing move\n");
-        executeMove(extractDirection(command), extractDistance(command));
-    } else if (strncmp(command, "HM", 2) == 0) {
-        // eg. "HM"
-        printf("Executing home\n");
-        executeHome();
-    } else if (strncmp(command, "MG", 2) == 0) {
-        // eg. "MG1"
-        printf("Executing toggleMagnet\n");
-        executeToggleMagnet(command[2]);
-    }else if(strncmp(command, "TM", 2) == 0){
-        // eg. TM[R/L][32byte time]
-       nrf_send(command + 2);
-    } 
-    return 0;
+/* The rook never followed a king-like move, or the board stopped matching any move */
+static void releaseMoves(void *arg) {
+    BoardMove moves[MAX_MOVES_PER_UPDATE];
+    portENTER_CRITICAL(&moveTrackerLock);
+    int count = moveTrackerRelease(&moveTracker, esp_timer_get_time(), moves);
+    int64_t deadlineUs = moveTrackerDeadline(&moveTracker);
+    portEXIT_CRITICAL(&moveTrackerLock);
+    scheduleMoveTracker(deadlineUs);
+    for (int i = 0; i < count; i++) {
+        publishMove(&moves[i]);
+    }
+    if (count > 0) {
+        sensorsSetHumanTurn(false);
+    }
 }
 
-int executeTextScript(const char script[]) {
-    const char commandDelimiter[] = ",";
-    char *rest, *command;
-
-    rest = strdup(script);
+static void publishBoard(uint64_t board, uint64_t changed) {
+#ifdef USE_WIFI
+    httpSetBoard(board, changed);
+#elif defined(USE_BLUETOOTH)
+    notifyBoard(board, changed);
+#endif
 
-    if (rest == NULL) {
-        perror("Memory allocation error");
-        exit(EXIT_FAILURE);
-        return 1;
+    BoardMove moves[MAX_MOVES_PER_UPDATE];
+    portENTER_CRITICAL(&moveTrackerLock);
+    int count = moveTrackerUpdate(&moveTracker, board, esp_timer_get_time(), moves);
+    int64_t deadlineUs = moveTrackerDeadline(&moveTracker);
+    portEXIT_CRITICAL(&moveTrackerLock);
+    scheduleMoveTracker(deadlineUs);
+    for (int i = 0; i < count; i++) {
+        publishMove(&moves[i]);
     }
-
-    printf("Executing script\n");
-    char *rest_copy = rest;
-    while ((command = strtok_r(rest, commandDelimiter, &rest)) != NULL) {
-        executeTextCommand(command);
+    if (count > 0) {
+        // The human has moved, the scanner can back off until the next TM command
+        sensorsSetHumanTurn(false);
     }
-
-    free(rest_copy);
-    return 0;
 }
 
 void app_main(void) {
-    disableMotor1();
-    disableMotor2();
-
 #ifdef USE_WIFI
     initNvs();
     setupWifi();
@@ -460,31 +315,17 @@ void app_main(void) {
 
 #endif
 
-    ESP_LOGI(TAG_RMT, "Initialize EN + DIR GPIO");
-    gpio_config_t io_config = {
-            .mode = GPIO_MODE_OUTPUT,
-            .intr_type = GPIO_INTR_DISABLE,
-            .pin_bit_mask = GPIO_OUTPUT_PIN_SEL};
-    gpio_config(&io_config);
-
-    io_config.pin_bit_mask = GPIO_INPUT_PIN_SEL;
-    io_config.mode = GPIO_MODE_INPUT;
-    io_config.pull_up_en = 1;
-    gpio_config(&io_config);
-
-    io_config.pin_bit_mask = GPIO_OUTPUT_MUX_SEL;
-    io_config.intr_type = GPIO_INTR_DISABLE;
-    io_config.mode = GPIO_MODE_OUTPUT;
-    io_config.pull_down_en = 0;
-    io_config.pull_up_en = 0;
-    gpio_config(&io_config);
-
-    io_config.pin_bit_mask = SENSOR_ARRAY;
-    io_config.mode = GPIO_MODE_INPUT;
-
-    gpio_config(&io_config);
-
-    setupRMT();
-    executeHome();
+    setupSensors();
+    // At power up the pieces are normally set up and nobody is touching them yet
+    sensorsCalibrate();
+    setupMotion();
+    setupExecutor(publishCommandEvent);
+    motionQueueHome(NULL, NULL, portMAX_DELAY);
     nrf_init();
+    esp_timer_create_args_t trackerTimerArgs = {
+            .callback = releaseMoves,
+            .name = "move_tracker",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&trackerTimerArgs, &moveTrackerTimer));
+    startBoardScanner(publishBoard, publishCarryLost);
 }
@@ -0,0 +1,1077 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "driver/gpio.h"
+#include "driver/rmt_tx.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "math.h"
+#include "stepper_motor_encoder.h"
+#include "motion.h"
+
+#define STEP_MOTOR_GPIO_STEP1 GPIO_NUM_37
+#define STEP_MOTOR_GPIO_STEP2 GPIO_NUM_47
+
+#define STEP_MOTOR_SLP1 GPIO_NUM_36
+#define STEP_MOTOR_DIR1 GPIO_NUM_38
+#define STEP_MOTOR_RST1 GPIO_NUM_35
+
+#define STEP_MOTOR_SLP2 GPIO_NUM_21
+#define STEP_MOTOR_DIR2 GPIO_NUM_48
+#define STEP_MOTOR_RST2 GPIO_NUM_45
+
+#define EM_TOGGLE GPIO_NUM_1
+
+#define GPIO_OUTPUT_RMT_SEL \
+    ((1ULL << STEP_MOTOR_GPIO_STEP1) | (1ULL << STEP_MOTOR_GPIO_STEP2))
+
+#define GPIO_OUTPUT_PIN_SEL (((1ULL << STEP_MOTOR_DIR1) | (1ULL << STEP_MOTOR_SLP1) | (1ULL << STEP_MOTOR_RST1) | (1ULL << STEP_MOTOR_DIR2) | (1ULL << STEP_MOTOR_SLP2) | (1ULL << STEP_MOTOR_RST2) | (1ULL << EM_TOGGLE)) | (GPIO_OUTPUT_RMT_SEL))
+
+#define EMERGENCY_OUTER GPIO_NUM_16
+#define EMERGENCY_INNER GPIO_NUM_15
+
+#define GPIO_INPUT_PIN_SEL \
+    ((1ULL << EMERGENCY_OUTER) | (1ULL << EMERGENCY_INNER))
+
+#define ORTHOGONAL_TILE_IN_STEPS 5860
+
+#define STEP_MOTOR_RESOLUTION_HZ 2000000  // 1MHz resolution
+#define TAG_RMT "RMT"
+#define TAG_MOTION "MOTION"
+
+#define MOTOR_COUNT 2
+// Lowest step rate the uniform encoder can express, its half period is a 15 bit tick count
+#define MIN_STEP_FREQ_HZ 100
+// Below this the slower motor of a vector move is not worth synchronising and runs afterwards
+#define MIN_SYNC_STEPS 16
+
+#define MOTION_IDLE_BIT (1 << 0)
+
+#define MOTION_NOTIFY_SEGMENT (1 << 0)
+#define MOTION_NOTIFY_LIMIT (1 << 1)
+#define MOTION_NOTIFY_ABORT (1 << 2)
+
+#define LIMIT_INNER_BIT (1 << 0)
+#define LIMIT_OUTER_BIT (1 << 1)
+
+// Centre of a1 as seen from the homing corner, calibrate per board
+#define BOARD_A1_X_STEPS (ORTHOGONAL_TILE_IN_STEPS / 2)
+#define BOARD_A1_Y_STEPS (ORTHOGONAL_TILE_IN_STEPS / 2)
+
+#define HOMING_MAX_TRAVEL_STEPS (9 * ORTHOGONAL_TILE_IN_STEPS)
+#define HOMING_BACKOFF_STEPS (ORTHOGONAL_TILE_IN_STEPS / 8)
+// Backing off gives up once the switch is still closed this far from where it closed
+#define HOMING_MAX_BACKOFF_STEPS (8 * HOMING_BACKOFF_STEPS)
+#define HOMING_SLOW_FREQ_HZ 2000
+
+// Reach of the head from the homing corner, calibrate per board. Only the near sides have switches,
+// so GO targets past these are refused rather than driven into the frame
+#define MOTION_MAX_X_STEPS HOMING_MAX_TRAVEL_STEPS
+#define MOTION_MAX_Y_STEPS HOMING_MAX_TRAVEL_STEPS
+
+// Time the drivers need after leaving sleep before they take step pulses
+#define MOTOR_WAKE_SETTLE_MS 2
+
+#define MOTOR_TRANS_QUEUE_DEPTH 10
+// Width of the RMT TX loop counter on the S3, longer uniform phases are split into chunks this size
+#define MAX_LOOP_STEPS 1023
+// rmt_transmit() only blocks once all queue slots are busy, so one more slot may be filled meanwhile
+#define SEGMENT_RING_SIZE (2 * MOTOR_TRANS_QUEUE_DEPTH)
+
+/* One transaction queued on a motor channel */
+typedef struct {
+    uint32_t steps;
+    uint32_t freqHz;  // Average step rate, used to estimate progress when the segment is cut short
+} TransmitSegment;
+
+/* Progress of the transactions queued on one motor channel */
+typedef struct {
+    TransmitSegment segments[SEGMENT_RING_SIZE];
+    uint32_t segmentsQueued;
+    uint32_t segmentsDone;
+    uint32_t stepsDone;  // Steps of the segments that already finished
+    int64_t segmentStartUs;
+} ChannelProgress;
+
+/* Phases one motor runs during a move, with the encoders and payloads RMT reads while it runs */
+typedef struct {
+    MovePlan plan;
+    uint32_t accelFreqHz;  // Uniform rate for the ramps when no curve encoder is used
+    uint32_t cruiseFreqHz;
+    uint32_t rampFreqHz;   // Average rate over a ramp
+    rmt_encoder_handle_t accelEncoder;
+    rmt_encoder_handle_t decelEncoder;
+    bool ownsEncoders;
+    uint32_t cruiseChunks;
+    int nextPhase;  // Streaming position: 0 accelerate, 1 cruise, 2 decelerate, 3 finished
+    uint32_t nextChunk;
+} MotorPlan;
+
+static const int dirConfigs[8][4] = {{1, 1, 1, 1},   // NO
+                                     {0, 0, 1, 1},   // SO
+                                     {0, 1, 1, 1},   // WE
+                                     {1, 0, 1, 1},   // EA
+                                     {1, 0, 1, 0},   // NE
+                                     {0, 1, 0, 1},   // NW
+                                     {0, 0, 1, 0},   // SW
+                                     {0, 0, 0, 1}};  // SE
+
+static const gpio_num_t stepGpios[MOTOR_COUNT] = {STEP_MOTOR_GPIO_STEP1, STEP_MOTOR_GPIO_STEP2};
+static const gpio_num_t dirGpios[MOTOR_COUNT] = {STEP_MOTOR_DIR1, STEP_MOTOR_DIR2};
+
+static rmt_channel_handle_t motor_chans[MOTOR_COUNT] = {NULL};
+static rmt_encoder_handle_t uniform_motor_encoders[MOTOR_COUNT] = {NULL};
+static rmt_encoder_handle_t accel_motor_encoders[MOTOR_COUNT][PROFILE_COUNT] = {{NULL}};
+static rmt_encoder_handle_t decel_motor_encoders[MOTOR_COUNT][PROFILE_COUNT] = {{NULL}};
+
+static QueueHandle_t motionQueue = NULL;
+static EventGroupHandle_t motionEvents = NULL;
+static portMUX_TYPE motionLock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t motionPending = 0;
+static uint32_t motionNextId = 1;
+static bool motorsEnabled = false;
+static volatile uint32_t motionIdleTimeoutMs = MOTION_IDLE_TIMEOUT_MS;
+static MotionCallback motionStarted = NULL;
+static int32_t motorSteps[MOTOR_COUNT] = {0};  // Signed steps of each motor since homing
+static bool positionKnown = false;
+
+static TaskHandle_t motionTaskHandle = NULL;
+static portMUX_TYPE transmitLock = portMUX_INITIALIZER_UNLOCKED;
+static ChannelProgress progress[MOTOR_COUNT];
+static volatile uint32_t armedLimits = 0;  // LIMIT_*_BIT switches allowed to stop the channels
+
+// Move being driven, for motionGetProgress(), guarded by motionLock
+static bool moveActive = false;
+static int32_t moveStartSteps[MOTOR_COUNT];
+static int32_t moveDelta[MOTOR_COUNT];
+static volatile bool magnetOn = false;
+
+void disableMotor1() {
+    gpio_set_level(STEP_MOTOR_RST1, 0);
+    gpio_set_level(STEP_MOTOR_SLP1, 1);
+}
+
+void disableMotor2() {
+    gpio_set_level(STEP_MOTOR_RST2, 0);
+    gpio_set_level(STEP_MOTOR_SLP2, 1);
+}
+
+void enableMotor1() {
+    gpio_set_level(STEP_MOTOR_RST1, 1);
+    gpio_set_level(STEP_MOTOR_SLP1, 1);
+}
+
+void enableMotor2() {
+    gpio_set_level(STEP_MOTOR_RST2, 1);
+    gpio_set_level(STEP_MOTOR_SLP2, 1);
+}
+
+bool isPressed(gpio_num_t input) {
+    return !gpio_get_level(input);
+}
+
+void toggleMotor(bool switchOn, int motor) {
+    if (motor == 1) {
+        if (switchOn) {
+            enableMotor1();
+        } else {
+            disableMotor1();
+        }
+    } else if (motor == 2) {
+        if (switchOn) {
+            enableMotor2();
+        } else {
+            disableMotor2();
+        }
+    }
+}
+
+void executeToggleMagnet(bool switchOn) {
+    gpio_set_level(EM_TOGGLE, switchOn);
+    magnetOn = switchOn;
+    vTaskDelay(200 / portTICK_PERIOD_MS);
+    printf("Magnet state: %d", switchOn);
+}
+
+static bool IRAM_ATTR onTransmitDone(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata,
+                                     void *user_ctx) {
+    ChannelProgress *motor = &progress[(uintptr_t) user_ctx];
+    BaseType_t highTaskWakeup = pdFALSE;
+    portENTER_CRITICAL_ISR(&transmitLock);
+    motor->stepsDone += motor->segments[motor->segmentsDone % SEGMENT_RING_SIZE].steps;
+    motor->segmentsDone++;
+    motor->segmentStartUs = esp_timer_get_time();
+    portEXIT_CRITICAL_ISR(&transmitLock);
+    // Wake the motion task to top the queue back up
+    xTaskNotifyFromISR(motionTaskHandle, MOTION_NOTIFY_SEGMENT, eSetBits, &highTaskWakeup);
+    return highTaskWakeup == pdTRUE;
+}
+
+static void IRAM_ATTR onLimitSwitch(void *arg) {
+    uint32_t limitBit = (uintptr_t) arg;
+    if (armedLimits & limitBit) {
+        BaseType_t highTaskWakeup = pdFALSE;
+        xTaskNotifyFromISR(motionTaskHandle, MOTION_NOTIFY_LIMIT, eSetBits, &highTaskWakeup);
+        portYIELD_FROM_ISR(highTaskWakeup);
+    }
+}
+
+static bool limitsPressed(uint32_t limits) {
+    return ((limits & LIMIT_INNER_BIT) && isPressed(EMERGENCY_INNER)) ||
+           ((limits & LIMIT_OUTER_BIT) && isPressed(EMERGENCY_OUTER));
+}
+
+static bool transmissionBusy() {
+    bool busy = false;
+    portENTER_CRITICAL(&transmitLock);
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        busy = busy || progress[i].segmentsDone != progress[i].segmentsQueued;
+    }
+    portEXIT_CRITICAL(&transmitLock);
+    return busy;
+}
+
+/*
+ * Start a new chain of transactions. Must only be called while nothing is transmitting.
+ */
+static void resetTransmission() {
+    portENTER_CRITICAL(&transmitLock);
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        progress[i].segmentsQueued = 0;
+        progress[i].segmentsDone = 0;
+        progress[i].stepsDone = 0;
+        progress[i].segmentStartUs = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&transmitLock);
+    // Any pending notification is left over from an earlier chain
+    xTaskNotifyStateClear(NULL);
+    ulTaskNotifyValueClear(NULL, UINT32_MAX);
+}
+
+static void queueTransmission(int motor, rmt_encoder_handle_t encoder, const void *payload, size_t payloadSize,
+                              int loopCount, uint32_t steps, uint32_t freqHz) {
+    rmt_transmit_config_t tx_config = {
+            .loop_count = loopCount,
+    };
+    ChannelProgress *channel = &progress[motor];
+    portENTER_CRITICAL(&transmitLock);
+    channel->segments[channel->segmentsQueued % SEGMENT_RING_SIZE] = (TransmitSegment) {
+            .steps = steps,
+            .freqHz = freqHz,
+    };
+    channel->segmentsQueued++;
+    portEXIT_CRITICAL(&transmitLock);
+    ESP_ERROR_CHECK(rmt_transmit(motor_chans[motor], encoder, payload, payloadSize, &tx_config));
+}
+
+static uint32_t segmentsInFlight(int motor) {
+    portENTER_CRITICAL(&transmitLock);
+    uint32_t inFlight = progress[motor].segmentsQueued - progress[motor].segmentsDone;
+    portEXIT_CRITICAL(&transmitLock);
+    return inFlight;
+}
+
+/*
+ * Steps a channel has driven by nowUs, transmitLock must be held. Finished segments are counted
+ * exactly from their done events, the running one is estimated from how long it has been going.
+ */
+static uint32_t estimateStepsDriven(const ChannelProgress *channel, int64_t nowUs) {
+    uint32_t driven = channel->stepsDone;
+    if (channel->segmentsDone != channel->segmentsQueued) {
+        const TransmitSegment *current = &channel->segments[channel->segmentsDone % SEGMENT_RING_SIZE];
+        uint64_t partial = (uint64_t) (nowUs - channel->segmentStartUs) * current->freqHz / 1000000;
+        driven += partial < current->steps ? partial : current->steps;
+    }
+    return driven;
+}
+
+/*
+ * Stop both channels asynchronously and drop whatever was still pending. Finished segments are
+ * counted exactly from their done events, the one that was cut short is estimated from how long
+ * it ran.
+ */
+static void abortTransmission(uint32_t stepsDriven[MOTOR_COUNT]) {
+    int64_t stopUs = esp_timer_get_time();
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        ESP_ERROR_CHECK(rmt_disable(motor_chans[i]));
+    }
+
+    portENTER_CRITICAL(&transmitLock);
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        stepsDriven[i] = estimateStepsDriven(&progress[i], stopUs);
+        progress[i].segmentsQueued = progress[i].segmentsDone;
+    }
+    portEXIT_CRITICAL(&transmitLock);
+
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        ESP_ERROR_CHECK(rmt_enable(motor_chans[i]));
+    }
+    // Forget a done event that raced with the stop
+    xTaskNotifyWait(0, UINT32_MAX, NULL, 0);
+}
+
+static uint32_t clampStepFreq(uint64_t freqHz) {
+    return freqHz < MIN_STEP_FREQ_HZ ? MIN_STEP_FREQ_HZ : freqHz;
+}
+
+static void planFastMotor(MotorPlan *motorPlan, int motor, MotionProfileType type, uint32_t steps) {
+    const MotionProfile *profile = &motionProfiles[type];
+    *motorPlan = (MotorPlan) {
+            .plan = planMove(profile, steps),
+            .cruiseFreqHz = profile->cruise_freq_hz,
+            .rampFreqHz = (profile->start_freq_hz + profile->cruise_freq_hz) / 2,
+            .accelEncoder = accel_motor_encoders[motor][type],
+            .decelEncoder = decel_motor_encoders[motor][type],
+    };
+}
+
+/*
+ * Plan the slower motor of a vector move so that each of its phases lasts as long as the matching
+ * phase of the faster motor. Its ramps are the fast ramps scaled down in rate and step count, built
+ * for this move only; when they would be too coarse the ramps run at their average rate instead.
+ */
+static void planSlowMotor(MotorPlan *motorPlan, const MotorPlan *fastPlan, MotionProfileType type,
+                          uint32_t fastSteps, uint32_t slowSteps) {
+    const MotionProfile *profile = &motionProfiles[type];
+    const MovePlan *fast = &fastPlan->plan;
+    double ratio = (double) slowSteps / fastSteps;
+    MovePlan plan = {
+            .accelSteps = lround(fast->accelSteps * ratio),
+            .decelSteps = lround(fast->decelSteps * ratio),
+    };
+    // Both channels need the same number of transactions for the synchronised start to line up
+    if (fast->accelSteps > 0 && plan.accelSteps == 0) {
+        plan.accelSteps = 1;
+    }
+    if (fast->decelSteps > 0 && plan.decelSteps == 0) {
+        plan.decelSteps = 1;
+    }
+    if (fast->cruiseSteps == 0) {
+        // Rounding leftovers go to the acceleration, there is no cruise phase to absorb them
+        plan.accelSteps = slowSteps - plan.decelSteps;
+    } else {
+        plan.cruiseSteps = slowSteps - MIN(slowSteps, plan.accelSteps + plan.decelSteps);
+        if (plan.cruiseSteps == 0) {
+            plan.cruiseSteps = 1;
+            if (plan.accelSteps >= plan.decelSteps) {
+                plan.accelSteps--;
+            } else {
+                plan.decelSteps--;
+            }
+        }
+    }
+
+    *motorPlan = (MotorPlan) {
+            .plan = plan,
+            .cruiseFreqHz = fast->cruiseSteps > 0
+                            ? clampStepFreq((uint64_t) plan.cruiseSteps * fastPlan->cruiseFreqHz / fast->cruiseSteps)
+                            : MIN_STEP_FREQ_HZ,
+            .rampFreqHz = clampStepFreq(lround(fastPlan->rampFreqHz * ratio)),
+    };
+    motorPlan->accelFreqHz = motorPlan->rampFreqHz;
+
+    stepper_motor_curve_encoder_config_t accel_encoder_config = {
+            .resolution = STEP_MOTOR_RESOLUTION_HZ,
+            .sample_points = lround(profile->ramp_steps * ratio),
+            .start_freq_hz = lround(profile->start_freq_hz * ratio),
+            .end_freq_hz = lround(profile->cruise_freq_hz * ratio),
+    };
+    bool curveUsable = accel_encoder_config.sample_points >= 2 &&
+                       accel_encoder_config.start_freq_hz >= MIN_STEP_FREQ_HZ &&
+                       accel_encoder_config.end_freq_hz - accel_encoder_config.start_freq_hz >=
+                       accel_encoder_config.sample_points &&
+                       plan.accelSteps <= accel_encoder_config.sample_points &&
+                       plan.decelSteps <= accel_encoder_config.sample_points;
+    if (curveUsable) {
+        stepper_motor_curve_encoder_config_t decel_encoder_config = accel_encoder_config;
+        decel_encoder_config.start_freq_hz = accel_encoder_config.end_freq_hz;
+        decel_encoder_config.end_freq_hz = accel_encoder_config.start_freq_hz;
+        curveUsable = rmt_new_stepper_motor_curve_encoder(&accel_encoder_config, &motorPlan->accelEncoder) == ESP_OK;
+        if (curveUsable &&
+            rmt_new_stepper_motor_curve_encoder(&decel_encoder_config, &motorPlan->decelEncoder) != ESP_OK) {
+            rmt_del_encoder(motorPlan->accelEncoder);
+            curveUsable = false;
+        }
+    }
+    if (!curveUsable) {
+        motorPlan->accelEncoder = NULL;
+        motorPlan->decelEncoder = NULL;
+    }
+    motorPlan->ownsEncoders = curveUsable;
+}
+
+static void planUniformMotor(MotorPlan *motorPlan, uint32_t freqHz, uint32_t steps) {
+    *motorPlan = (MotorPlan) {
+            .plan = {.cruiseSteps = steps},
+            .cruiseFreqHz = freqHz,
+            .rampFreqHz = freqHz,
+            .cruiseChunks = chunkCount(steps, MAX_LOOP_STEPS),
+    };
+}
+
+static void queueRamp(int motor, MotorPlan *motorPlan, rmt_encoder_handle_t curveEncoder, uint32_t *steps) {
+    if (curveEncoder) {
+        queueTransmission(motor, curveEncoder, steps, sizeof(*steps), 0, *steps, motorPlan->rampFreqHz);
+    } else {
+        queueTransmission(motor, uniform_motor_encoders[motor], &motorPlan->accelFreqHz,
+                          sizeof(motorPlan->accelFreqHz), *steps, *steps, motorPlan->accelFreqHz);
+    }
+}
+
+/*
+ * Queue the next transaction of a motor: its acceleration ramp, one loop-count sized chunk of the
+ * cruise phase or its deceleration ramp. Returns false once the whole plan has been queued.
+ */
+static bool queueNextSegment(int motor, MotorPlan *motorPlan) {
+    MovePlan *plan = &motorPlan->plan;
+    switch (motorPlan->nextPhase) {
+        case 0:
+            motorPlan->nextPhase++;
+            if (plan->accelSteps > 0) {
+                queueRamp(motor, motorPlan, motorPlan->accelEncoder, &plan->accelSteps);
+                return true;
+            }
+            // fall through
+        case 1:
+            if (motorPlan->nextChunk < motorPlan->cruiseChunks) {
+                uint32_t steps = chunkSteps(plan->cruiseSteps, motorPlan->cruiseChunks, motorPlan->nextChunk++);
+                queueTransmission(motor, uniform_motor_encoders[motor], &motorPlan->cruiseFreqHz,
+                                  sizeof(motorPlan->cruiseFreqHz), steps, steps, motorPlan->cruiseFreqHz);
+                return true;
+            }
+            motorPlan->nextPhase++;
+            // fall through
+        case 2:
+            motorPlan->nextPhase++;
+            if (plan->decelSteps > 0) {
+                queueRamp(motor, motorPlan, motorPlan->decelEncoder, &plan->decelSteps);
+                return true;
+            }
+            // fall through
+        default:
+            return false;
+    }
+}
+
+/*
+ * Run the planned phases on every motor that has steps. Segments are streamed: each channel is kept
+ * one short of its transaction queue depth so rmt_transmit() never blocks, and every done event tops
+ * it back up, so the next chunk is always loaded when the current one ends while an armed limit
+ * switch can still be served at once. With two motors the channels sit in a sync group for the move
+ * and get the same number of transactions, so their phases start together.
+ */
+static MotionOutcome transmitMotorPlans(MotorPlan plans[MOTOR_COUNT], uint32_t stepsDriven[MOTOR_COUNT]) {
+    rmt_sync_manager_handle_t synchro = NULL;
+    MotionOutcome outcome = MOTION_COMPLETED;
+    int movingCount = 0;
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        const MovePlan *plan = &plans[i].plan;
+        movingCount += plan->accelSteps + plan->cruiseSteps + plan->decelSteps > 0;
+        plans[i].nextPhase = 0;
+        plans[i].nextChunk = 0;
+    }
+
+    resetTransmission();
+    // The clear above also drops the notification of an armed switch that closed just before it
+    if (limitsPressed(armedLimits)) {
+        outcome = MOTION_LIMIT_HIT;
+        for (int i = 0; i < MOTOR_COUNT; i++) {
+            stepsDriven[i] = 0;
+        }
+    } else if (movingCount == MOTOR_COUNT) {
+        rmt_sync_manager_config_t synchro_config = {
+                .tx_channel_array = motor_chans,
+                .array_size = MOTOR_COUNT,
+        };
+        ESP_ERROR_CHECK(rmt_new_sync_manager(&synchro_config, &synchro));
+    }
+
+    while (outcome == MOTION_COMPLETED) {
+        for (int i = 0; i < MOTOR_COUNT; i++) {
+            while (segmentsInFlight(i) < MOTOR_TRANS_QUEUE_DEPTH - 1 && queueNextSegment(i, &plans[i])) {
+            }
+        }
+        if (!transmissionBusy()) {
+            break;
+        }
+
+        uint32_t notification = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &notification, portMAX_DELAY);
+        if (notification & (MOTION_NOTIFY_LIMIT | MOTION_NOTIFY_ABORT)) {
+            abortTransmission(stepsDriven);
+            outcome = notification & MOTION_NOTIFY_LIMIT ? MOTION_LIMIT_HIT : MOTION_ABORTED;
+            break;
+        }
+    }
+    if (outcome == MOTION_COMPLETED) {
+        for (int i = 0; i < MOTOR_COUNT; i++) {
+            stepsDriven[i] = progress[i].stepsDone;
+        }
+    }
+
+    if (synchro) {
+        ESP_ERROR_CHECK(rmt_del_sync_manager(synchro));
+    }
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        if (plans[i].ownsEncoders) {
+            rmt_del_encoder(plans[i].accelEncoder);
+            rmt_del_encoder(plans[i].decelEncoder);
+        }
+    }
+    return outcome;
+}
+
+/*
+ * Drive each motor its own number of steps along a single straight line. The faster motor follows
+ * the profile and the slower one is scaled to finish together with it.
+ */
+static MotionOutcome transmitProfiledSteps(MotionProfileType type, const uint32_t steps[MOTOR_COUNT],
+                                           uint32_t stepsDriven[MOTOR_COUNT]) {
+    MotorPlan plans[MOTOR_COUNT];
+    int fast = steps[0] >= steps[1] ? 0 : 1;
+    int slow = 1 - fast;
+
+    stepsDriven[0] = 0;
+    stepsDriven[1] = 0;
+    if (steps[fast] == 0) {
+        return MOTION_COMPLETED;
+    }
+
+    planFastMotor(&plans[fast], fast, type, steps[fast]);
+    uint32_t cruiseChunks = chunkCount(plans[fast].plan.cruiseSteps, MAX_LOOP_STEPS);
+    plans[fast].cruiseChunks = cruiseChunks;
+
+    // Synchronised channels need matching chunk counts, so the slow cruise needs a step per chunk
+    bool synchronised = false;
+    if (steps[slow] == steps[fast]) {
+        planFastMotor(&plans[slow], slow, type, steps[slow]);
+        synchronised = true;
+    } else if (steps[slow] >= MIN_SYNC_STEPS) {
+        planSlowMotor(&plans[slow], &plans[fast], type, steps[fast], steps[slow]);
+        synchronised = plans[slow].plan.cruiseSteps >= cruiseChunks;
+        if (!synchronised && plans[slow].ownsEncoders) {
+            rmt_del_encoder(plans[slow].accelEncoder);
+            rmt_del_encoder(plans[slow].decelEncoder);
+        }
+    }
+    if (synchronised) {
+        plans[slow].cruiseChunks = plans[slow].plan.cruiseSteps > 0 ? cruiseChunks : 0;
+    } else {
+        planUniformMotor(&plans[slow], 0, 0);
+    }
+
+    MotionOutcome outcome = transmitMotorPlans(plans, stepsDriven);
+
+    // A remainder too small to synchronise runs on its own at the start rate
+    if (outcome == MOTION_COMPLETED && !synchronised && steps[slow] > 0) {
+        uint32_t remainderDriven[MOTOR_COUNT];
+        planUniformMotor(&plans[fast], 0, 0);
+        planUniformMotor(&plans[slow], motionProfiles[type].start_freq_hz, steps[slow]);
+        outcome = transmitMotorPlans(plans, remainderDriven);
+        stepsDriven[slow] = remainderDriven[slow];
+    }
+    return outcome;
+}
+
+static MotionOutcome transmitUniformSteps(uint32_t freqHz, const uint32_t steps[MOTOR_COUNT],
+                                          uint32_t stepsDriven[MOTOR_COUNT]) {
+    MotorPlan plans[MOTOR_COUNT];
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        planUniformMotor(&plans[i], freqHz, steps[i]);
+    }
+    return transmitMotorPlans(plans, stepsDriven);
+}
+
+static void setMotorDirections(const int32_t motorDelta[MOTOR_COUNT]) {
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        gpio_set_level(dirGpios[i], motorDelta[i] >= 0);
+    }
+}
+
+static void setDirection(Direction dir) {
+    gpio_set_level(STEP_MOTOR_DIR1, dirConfigs[dir][0]);
+    gpio_set_level(STEP_MOTOR_DIR2, dirConfigs[dir][1]);
+}
+
+/*
+ * Limit switches in the way of a move. The head is driven CoreXY style, so it heads west when
+ * motor 2 outruns motor 1 and south when their sum is negative.
+ */
+static uint32_t limitsInTheWay(const int32_t motorDelta[MOTOR_COUNT]) {
+    uint32_t limits = 0;
+    if (motorDelta[0] - motorDelta[1] < 0) {
+        limits |= LIMIT_OUTER_BIT;
+    }
+    if (motorDelta[0] + motorDelta[1] < 0) {
+        limits |= LIMIT_INNER_BIT;
+    }
+    return limits;
+}
+
+/*
+ * Keeping the signed step count of each motor tracks the position exactly, with
+ * x = (motor1 - motor2) / 2 and y = (motor1 + motor2) / 2 in orthogonal steps.
+ */
+static void trackSteps(const int32_t motorDelta[MOTOR_COUNT], const uint32_t stepsDriven[MOTOR_COUNT]) {
+    portENTER_CRITICAL(&motionLock);
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        motorSteps[i] += motorDelta[i] >= 0 ? (int32_t) stepsDriven[i] : -(int32_t) stepsDriven[i];
+    }
+    portEXIT_CRITICAL(&motionLock);
+}
+
+bool motionGetPosition(int32_t *xSteps, int32_t *ySteps) {
+    portENTER_CRITICAL(&motionLock);
+    int32_t motor1 = motorSteps[0];
+    int32_t motor2 = motorSteps[1];
+    bool known = positionKnown;
+    portEXIT_CRITICAL(&motionLock);
+    *xSteps = (motor1 - motor2) / 2;
+    *ySteps = (motor1 + motor2) / 2;
+    return known;
+}
+
+bool motionGetProgress(MotionProgress *moveProgress) {
+    int32_t driven[MOTOR_COUNT];
+    int64_t nowUs = esp_timer_get_time();
+    portENTER_CRITICAL(&transmitLock);
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        driven[i] = (int32_t) estimateStepsDriven(&progress[i], nowUs);
+    }
+    portEXIT_CRITICAL(&transmitLock);
+
+    portENTER_CRITICAL(&motionLock);
+    bool active = moveActive && positionKnown;
+    int32_t start[MOTOR_COUNT] = {moveStartSteps[0], moveStartSteps[1]};
+    int32_t delta[MOTOR_COUNT] = {moveDelta[0], moveDelta[1]};
+    portEXIT_CRITICAL(&motionLock);
+    if (!active) {
+        return false;
+    }
+
+    int32_t head[MOTOR_COUNT];
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        int32_t steps = MIN(driven[i], abs(delta[i]));
+        head[i] = start[i] + (delta[i] >= 0 ? steps : -steps);
+    }
+    *moveProgress = (MotionProgress) {
+            .magnetOn = magnetOn,
+            .fromX = (start[0] - start[1]) / 2,
+            .fromY = (start[0] + start[1]) / 2,
+            .toX = (start[0] + delta[0] - start[1] - delta[1]) / 2,
+            .toY = (start[0] + delta[0] + start[1] + delta[1]) / 2,
+            .headX = (head[0] - head[1]) / 2,
+            .headY = (head[0] + head[1]) / 2,
+    };
+    return true;
+}
+
+bool motionMagnetOn() {
+    return magnetOn;
+}
+
+void motionAbortMove() {
+    xTaskNotify(motionTaskHandle, MOTION_NOTIFY_ABORT, eSetBits);
+}
+
+int motionSquareAt(int32_t xSteps, int32_t ySteps) {
+    // Squares are a tile wide around their centres, a1 is centred on BOARD_A1_*_STEPS
+    int32_t x = xSteps - BOARD_A1_X_STEPS + ORTHOGONAL_TILE_IN_STEPS / 2;
+    int32_t y = ySteps - BOARD_A1_Y_STEPS + ORTHOGONAL_TILE_IN_STEPS / 2;
+    if (x < 0 || y < 0 || x >= 8 * ORTHOGONAL_TILE_IN_STEPS || y >= 8 * ORTHOGONAL_TILE_IN_STEPS) {
+        return -1;
+    }
+    return (y / ORTHOGONAL_TILE_IN_STEPS) * 8 + x / ORTHOGONAL_TILE_IN_STEPS;
+}
+
+/*
+ * Move by a signed number of steps per motor as one straight line, stopping on any limit switch in
+ * the way. stepsDriven gets the steps of the busiest motor.
+ */
+static MotionOutcome executeMotorSteps(const int32_t motorDelta[MOTOR_COUNT], MotionProfileType type,
+                                       int *stepsDriven) {
+    uint32_t steps[MOTOR_COUNT] = {abs(motorDelta[0]), abs(motorDelta[1])};
+    uint32_t driven[MOTOR_COUNT] = {0};
+    MotionOutcome outcome = MOTION_LIMIT_HIT;
+
+    setMotorDirections(motorDelta);
+    ESP_LOGD(TAG_MOTION, "Motor steps: M1 = %" PRId32 ", M2 = %" PRId32, motorDelta[0], motorDelta[1]);
+
+    portENTER_CRITICAL(&motionLock);
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        moveStartSteps[i] = motorSteps[i];
+        moveDelta[i] = motorDelta[i];
+    }
+    moveActive = true;
+    portEXIT_CRITICAL(&motionLock);
+
+    // Arm before checking so a switch closing in between is not missed
+    uint32_t limits = limitsInTheWay(motorDelta);
+    armedLimits = limits;
+    if (!limitsPressed(limits)) {
+        outcome = transmitProfiledSteps(type, steps, driven);
+    }
+    armedLimits = 0;
+    trackSteps(motorDelta, driven);
+
+    portENTER_CRITICAL(&motionLock);
+    moveActive = false;
+    portEXIT_CRITICAL(&motionLock);
+
+    if (outcome == MOTION_ABORTED) {
+        ESP_LOGW(TAG_MOTION, "Move aborted after %" PRIu32 "/%" PRIu32 " and %" PRIu32 "/%" PRIu32 " steps",
+                 driven[0], steps[0], driven[1], steps[1]);
+    } else if (outcome == MOTION_LIMIT_HIT) {
+        ESP_LOGW(TAG_MOTION, "Limit switch hit after %" PRIu32 "/%" PRIu32 " and %" PRIu32 "/%" PRIu32 " steps",
+                 driven[0], steps[0], driven[1], steps[1]);
+    }
+
+    if (stepsDriven) {
+        *stepsDriven = MAX(driven[0], driven[1]);
+    }
+    return outcome;
+}
+
+/*
+ * Orthogonal directions step both motors, diagonals only the one flagged in dirConfigs. A diagonal
+ * half tile moves half a tile along both axes, which is a full tile worth of steps on that motor.
+ */
+MotionOutcome executeMove(Direction dir, double numHalfTiles, int *stepsDriven) {
+    int32_t motorDelta[MOTOR_COUNT];
+    int32_t steps = lround((ORTHOGONAL_TILE_IN_STEPS / 2) * numHalfTiles);
+    if (dir > 3) {
+        steps *= 2;
+    }
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        motorDelta[i] = dirConfigs[dir][2 + i] ? (dirConfigs[dir][i] ? steps : -steps) : 0;
+    }
+    printf("dirConfigs %i : DIR1 = %i, DIR2 = %i, M1  = %i, M2  = %i \n", dir, dirConfigs[dir][0],
+           dirConfigs[dir][1], dirConfigs[dir][2], dirConfigs[dir][3]);
+    return executeMotorSteps(motorDelta, dir > 3 ? PROFILE_DIAGONAL : PROFILE_ORTHOGONAL, stepsDriven);
+}
+
+/*
+ * Zero one axis: run towards the switch until its interrupt stops the channels, back off until it
+ * releases and come back slowly so the final stop always happens at the same speed. Fails if the
+ * switch is never reached or doesn't release again.
+ */
+static bool homeAxis(Direction towards, Direction away, gpio_num_t limit, uint32_t limitBit) {
+    const uint32_t approachSteps[MOTOR_COUNT] = {HOMING_MAX_TRAVEL_STEPS, HOMING_MAX_TRAVEL_STEPS};
+    const uint32_t backoffSteps[MOTOR_COUNT] = {HOMING_BACKOFF_STEPS, HOMING_BACKOFF_STEPS};
+    uint32_t driven[MOTOR_COUNT];
+
+    armedLimits = limitBit;
+    if (!isPressed(limit)) {
+        setDirection(towards);
+        if (transmitProfiledSteps(PROFILE_HOMING, approachSteps, driven) != MOTION_LIMIT_HIT) {
+            armedLimits = 0;
+            return false;
+        }
+    }
+    armedLimits = 0;
+
+    // However far the switch travels before it opens again
+    setDirection(away);
+    uint32_t backedOff = 0;
+    while (isPressed(limit) && backedOff < HOMING_MAX_BACKOFF_STEPS) {
+        transmitProfiledSteps(PROFILE_HOMING, backoffSteps, driven);
+        backedOff += HOMING_BACKOFF_STEPS;
+    }
+    if (isPressed(limit)) {
+        ESP_LOGE(TAG_MOTION, "Limit switch still closed after backing off %" PRIu32 " steps", backedOff);
+        return false;
+    }
+
+    // The switch closes again within the distance backed off, the rest is margin
+    const uint32_t reapproachSteps[MOTOR_COUNT] = {backedOff + HOMING_BACKOFF_STEPS,
+                                                   backedOff + HOMING_BACKOFF_STEPS};
+    armedLimits = limitBit;
+    setDirection(towards);
+    MotionOutcome outcome = transmitUniformSteps(HOMING_SLOW_FREQ_HZ, reapproachSteps, driven);
+    armedLimits = 0;
+    return outcome == MOTION_LIMIT_HIT && isPressed(limit);
+}
+
+/* Home both axes, MOTION_NOT_HOMED if either switch wasn't found or stayed closed */
+MotionOutcome executeHome() {
+    printf("IN GET HOME\n");
+    bool homed = homeAxis(SO, NO, EMERGENCY_INNER, LIMIT_INNER_BIT);
+    homed = homeAxis(WE, EA, EMERGENCY_OUTER, LIMIT_OUTER_BIT) && homed;
+
+    portENTER_CRITICAL(&motionLock);
+    motorSteps[0] = 0;
+    motorSteps[1] = 0;
+    positionKnown = homed;
+    portEXIT_CRITICAL(&motionLock);
+
+    if (!homed) {
+        ESP_LOGE(TAG_MOTION, "Limit switch not found while homing, position unknown");
+    }
+    printf("HOME");
+    return homed ? MOTION_COMPLETED : MOTION_NOT_HOMED;
+}
+
+/*
+ * Go to an absolute position along a straight line, each motor stepping at its own rate.
+ * Motor targets follow from motor1 = x + y and motor2 = y - x.
+ */
+static MotionOutcome executeGoto(int32_t targetX, int32_t targetY, int *stepsDriven) {
+    *stepsDriven = 0;
+    portENTER_CRITICAL(&motionLock);
+    bool known = positionKnown;
+    int32_t motorDelta[MOTOR_COUNT] = {
+            targetX + targetY - motorSteps[0],
+            targetY - targetX - motorSteps[1],
+    };
+    portEXIT_CRITICAL(&motionLock);
+    if (!known) {
+        ESP_LOGW(TAG_MOTION, "Position unknown, home before using GO");
+        return MOTION_NOT_HOMED;
+    }
+    if (targetX < 0 || targetX > MOTION_MAX_X_STEPS || targetY < 0 || targetY > MOTION_MAX_Y_STEPS) {
+        ESP_LOGW(TAG_MOTION, "GO target %" PRId32 ",%" PRId32 " out of reach", targetX, targetY);
+        return MOTION_OUT_OF_RANGE;
+    }
+
+    bool diagonal = motorDelta[0] == 0 || motorDelta[1] == 0;
+    return executeMotorSteps(motorDelta, diagonal ? PROFILE_DIAGONAL : PROFILE_ORTHOGONAL, stepsDriven);
+}
+
+static void setupRMT() {
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        ESP_LOGI(TAG_RMT, "Create RMT TX channel %d", i);
+        rmt_tx_channel_config_t tx_chan_config = {
+                .clk_src = RMT_CLK_SRC_DEFAULT,  // select clock source
+                .gpio_num = stepGpios[i],
+                .mem_block_symbols = 64,
+                .resolution_hz = STEP_MOTOR_RESOLUTION_HZ,
+                .trans_queue_depth = MOTOR_TRANS_QUEUE_DEPTH,  // set the number of transactions that can be pending in the background
+        };
+        ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &motor_chans[i]));
+
+        stepper_motor_uniform_encoder_config_t uniform_encoder_config = {
+                .resolution = STEP_MOTOR_RESOLUTION_HZ,
+        };
+
+        ESP_ERROR_CHECK(rmt_new_stepper_motor_uniform_encoder(&uniform_encoder_config, &uniform_motor_encoders[i]));
+
+        for (int j = 0; j < PROFILE_COUNT; j++) {
+            stepper_motor_curve_encoder_config_t accel_encoder_config = {
+                    .resolution = STEP_MOTOR_RESOLUTION_HZ,
+                    .sample_points = motionProfiles[j].ramp_steps,
+                    .start_freq_hz = motionProfiles[j].start_freq_hz,
+                    .end_freq_hz = motionProfiles[j].cruise_freq_hz,
+            };
+            stepper_motor_curve_encoder_config_t decel_encoder_config = {
+                    .resolution = STEP_MOTOR_RESOLUTION_HZ,
+                    .sample_points = motionProfiles[j].ramp_steps,
+                    .start_freq_hz = motionProfiles[j].cruise_freq_hz,
+                    .end_freq_hz = motionProfiles[j].start_freq_hz,
+            };
+            ESP_ERROR_CHECK(rmt_new_stepper_motor_curve_encoder(&accel_encoder_config, &accel_motor_encoders[i][j]));
+            ESP_ERROR_CHECK(rmt_new_stepper_motor_curve_encoder(&decel_encoder_config, &decel_motor_encoders[i][j]));
+        }
+
+        rmt_tx_event_callbacks_t callbacks = {
+                .on_trans_done = onTransmitDone,
+        };
+        ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(motor_chans[i], &callbacks, (void *) (uintptr_t) i));
+
+        ESP_LOGI(TAG_RMT, "Enable RMT channel %d", i);
+        ESP_ERROR_CHECK(rmt_enable(motor_chans[i]));
+    }
+}
+
+/*
+ * Wake or sleep both drivers. The settle delay is only paid when they actually wake up, commands
+ * arriving while they still hold the head start straight away.
+ */
+static void holdMotors(bool enable) {
+    if (enable == motorsEnabled) {
+        return;
+    }
+    toggleMotor(enable, 1);
+    toggleMotor(enable, 2);
+    motorsEnabled = enable;
+    if (enable) {
+        vTaskDelay(MAX(1, pdMS_TO_TICKS(MOTOR_WAKE_SETTLE_MS)));
+    }
+}
+
+static void motionTask(void *arg) {
+    MotionCommand command;
+    for (;;) {
+        // While the drivers are awake wait at most the idle timeout for the next command
+        TickType_t wait = motorsEnabled ? pdMS_TO_TICKS(motionIdleTimeoutMs) : portMAX_DELAY;
+        if (xQueueReceive(motionQueue, &command, wait) != pdTRUE) {
+            holdMotors(false);
+            continue;
+        }
+
+        MotionResult result = {
+                .id = command.id,
+                .type = command.type,
+                .outcome = MOTION_COMPLETED,
+                .steps = 0,
+        };
+        if (motionStarted) {
+            motionStarted(&result, command.ctx);
+        }
+        int64_t startUs = esp_timer_get_time();
+        switch (command.type) {
+            case MOTION_MOVE:
+                holdMotors(true);
+                result.outcome = executeMove(command.dir, command.numHalfTiles, &result.steps);
+                break;
+            case MOTION_HOME:
+                holdMotors(true);
+                result.outcome = executeHome();
+                break;
+            case MOTION_MAGNET:
+                executeToggleMagnet(command.magnetOn);
+                break;
+            case MOTION_GOTO:
+                holdMotors(true);
+                result.outcome = executeGoto(command.targetX, command.targetY, &result.steps);
+                break;
+        }
+
+        result.durationUs = esp_timer_get_time() - startUs;
+        ESP_LOGD(TAG_MOTION, "Command %" PRIu32 " (type %d) took %" PRId64 " us, %d steps", result.id, result.type,
+                 result.durationUs, result.steps);
+
+        if (command.onDone) {
+            command.onDone(&result, command.ctx);
+        }
+
+        portENTER_CRITICAL(&motionLock);
+        bool idle = --motionPending == 0;
+        portEXIT_CRITICAL(&motionLock);
+        if (idle) {
+            xEventGroupSetBits(motionEvents, MOTION_IDLE_BIT);
+        }
+    }
+}
+
+static uint32_t queueMotionCommand(MotionCommand *command, TickType_t timeout) {
+    // The pending count goes up before the send so motionWaitIdle() can't slip in between
+    portENTER_CRITICAL(&motionLock);
+    command->id = motionNextId++;
+    if (motionNextId == 0) {
+        motionNextId = 1;
+    }
+    motionPending++;
+    portEXIT_CRITICAL(&motionLock);
+    xEventGroupClearBits(motionEvents, MOTION_IDLE_BIT);
+
+    if (xQueueSend(motionQueue, command, timeout) != pdTRUE) {
+        ESP_LOGW(TAG_MOTION, "Motion queue full, dropping command");
+        portENTER_CRITICAL(&motionLock);
+        bool idle = --motionPending == 0;
+        portEXIT_CRITICAL(&motionLock);
+        if (idle) {
+            xEventGroupSetBits(motionEvents, MOTION_IDLE_BIT);
+        }
+        return 0;
+    }
+    return command->id;
+}
+
+uint32_t motionQueueMove(Direction dir, double numHalfTiles, MotionCallback onDone, void *ctx, TickType_t timeout) {
+    MotionCommand command = {
+            .type = MOTION_MOVE,
+            .dir = dir,
+            .numHalfTiles = numHalfTiles,
+            .onDone = onDone,
+            .ctx = ctx,
+    };
+    return queueMotionCommand(&command, timeout);
+}
+
+uint32_t motionQueueHome(MotionCallback onDone, void *ctx, TickType_t timeout) {
+    MotionCommand command = {
+            .type = MOTION_HOME,
+            .onDone = onDone,
+            .ctx = ctx,
+    };
+    return queueMotionCommand(&command, timeout);
+}
+
+uint32_t motionQueueMagnet(bool switchOn, MotionCallback onDone, void *ctx, TickType_t timeout) {
+    MotionCommand command = {
+            .type = MOTION_MAGNET,
+            .magnetOn = switchOn,
+            .onDone = onDone,
+            .ctx = ctx,
+    };
+    return queueMotionCommand(&command, timeout);
+}
+
+/*
+ * Steps from the homing corner of a position in tiles from a1. Targets far out of reach are cut
+ * down to just out of reach, so they can't overflow and still fail the range check.
+ */
+static int32_t tilesToSteps(double a1Steps, double tiles, int32_t maxSteps) {
+    double steps = a1Steps + tiles * ORTHOGONAL_TILE_IN_STEPS;
+    return lround(fmin(fmax(steps, -1.0), maxSteps + 1.0));
+}
+
+uint32_t motionQueueGoto(double xTiles, double yTiles, MotionCallback onDone, void *ctx, TickType_t timeout) {
+    MotionCommand command = {
+            .type = MOTION_GOTO,
+            .targetX = tilesToSteps(BOARD_A1_X_STEPS, xTiles, MOTION_MAX_X_STEPS),
+            .targetY = tilesToSteps(BOARD_A1_Y_STEPS, yTiles, MOTION_MAX_Y_STEPS),
+            .onDone = onDone,
+            .ctx = ctx,
+    };
+    return queueMotionCommand(&command, timeout);
+}
+
+void motionSetStartCallback(MotionCallback onStart) {
+    motionStarted = onStart;
+}
+
+void motionSetIdleTimeout(uint32_t timeoutMs) {
+    motionIdleTimeoutMs = timeoutMs;
+}
+
+bool motionWaitIdle(TickType_t timeout) {
+    return xEventGroupWaitBits(motionEvents, MOTION_IDLE_BIT, pdFALSE, pdTRUE, timeout) & MOTION_IDLE_BIT;
+}
+
+void setupMotion() {
+    ESP_LOGI(TAG_RMT, "Initialize EN + DIR GPIO");
+    gpio_config_t io_config = {
+            .mode = GPIO_MODE_OUTPUT,
+            .intr_type = GPIO_INTR_DISABLE,
+            .pin_bit_mask = GPIO_OUTPUT_PIN_SEL};
+    gpio_config(&io_config);
+
+    io_config.pin_bit_mask = GPIO_INPUT_PIN_SEL;
+    io_config.mode = GPIO_MODE_INPUT;
+    io_config.pull_up_en = 1;
+    io_config.intr_type = GPIO_INTR_NEGEDGE;
+    gpio_config(&io_config);
+
+    ESP_ERROR_CHECK(gpio_install_isr_service(0));
+    ESP_ERROR_CHECK(gpio_isr_handler_add(EMERGENCY_INNER, onLimitSwitch, (void *) LIMIT_INNER_BIT));
+    ESP_ERROR_CHECK(gpio_isr_handler_add(EMERGENCY_OUTER, onLimitSwitch, (void *) LIMIT_OUTER_BIT));
+
+    disableMotor1();
+    disableMotor2();
+
+    setupRMT();
+
+    motionQueue = xQueueCreate(MOTION_QUEUE_LENGTH, sizeof(MotionCommand));
+    motionEvents = xEventGroupCreate();
+    xEventGroupSetBits(motionEvents, MOTION_IDLE_BIT);
+    xTaskCreatePinnedToCore(motionTask, "motion", MOTION_TASK_STACK_SIZE, NULL, MOTION_TASK_PRIORITY,
+                            &motionTaskHandle, MOTION_TASK_CORE);
+}
@@ -0,0 +1,144 @@
+#ifndef ESP32_BOARDCODE_MOTION_H
+#define ESP32_BOARDCODE_MOTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "motion_profile.h"
+
+#define MOTION_QUEUE_LENGTH 32
+#define MOTION_TASK_CORE 1
+#define MOTION_TASK_PRIORITY 10
+#define MOTION_TASK_STACK_SIZE 4096
+// Drivers keep holding the head this long after the last queued command before they go to sleep
+#define MOTION_IDLE_TIMEOUT_MS 2000
+
+typedef enum {
+    NO = 0,
+    SO = 1,
+    WE = 2,
+    EA = 3,
+
+    NE = 4,
+    NW = 5,
+    SW = 6,
+    SE = 7
+} Direction;
+
+typedef enum {
+    MOTION_MOVE,
+    MOTION_HOME,
+    MOTION_MAGNET,
+    MOTION_GOTO,
+} MotionCommandType;
+
+typedef enum {
+    MOTION_COMPLETED,
+    MOTION_LIMIT_HIT,  // A limit switch closed, before or during the move
+    MOTION_NOT_HOMED,  // Homing failed, or absolute move requested before homing succeeded
+    MOTION_ABORTED,    // Stopped by motionAbortMove()
+    MOTION_OUT_OF_RANGE,  // Absolute move to a position the head can't reach
+} MotionOutcome;
+
+typedef struct {
+    uint32_t id;
+    MotionCommandType type;
+    MotionOutcome outcome;
+    int steps;  // Steps actually driven for MOTION_MOVE, 0 otherwise
+    int64_t durationUs;  // Wall time the command ran for, including a driver wake-up
+} MotionResult;
+
+/* Called from the motion task once a queued command has finished. Must not block for long. */
+typedef void (*MotionCallback)(const MotionResult *result, void *ctx);
+
+/* A move as it is being driven, positions in orthogonal steps from home */
+typedef struct {
+    bool magnetOn;
+    int32_t fromX;
+    int32_t fromY;
+    int32_t toX;  // Where the move ends unless it is stopped
+    int32_t toY;
+    int32_t headX;  // Estimated from the steps the channels have driven so far
+    int32_t headY;
+} MotionProgress;
+
+/* One entry of the motion queue */
+typedef struct {
+    uint32_t id;
+    MotionCommandType type;
+    Direction dir;
+    double numHalfTiles;
+    bool magnetOn;
+    int32_t targetX;  // MOTION_GOTO target in orthogonal steps from home
+    int32_t targetY;
+    MotionCallback onDone;
+    void *ctx;
+} MotionCommand;
+
+/*
+ * Configure the motor GPIOs and the RMT channel and start the motion task.
+ */
+void setupMotion();
+
+/*
+ * Queue commands for the motion task. They run in order and the call returns as soon as the
+ * command is queued, with the id passed to onDone, or 0 if the queue stayed full for timeout.
+ */
+uint32_t motionQueueMove(Direction dir, double numHalfTiles, MotionCallback onDone, void *ctx, TickType_t timeout);
+uint32_t motionQueueHome(MotionCallback onDone, void *ctx, TickType_t timeout);
+uint32_t motionQueueMagnet(bool switchOn, MotionCallback onDone, void *ctx, TickType_t timeout);
+
+/*
+ * Queue a move to an absolute position, in tiles from the centre of a1 along files (x) and ranks (y).
+ * The path is planned by the motion task from wherever the head is once the command runs. Positions
+ * off the board are fine as long as the head can reach them, others end with MOTION_OUT_OF_RANGE.
+ */
+uint32_t motionQueueGoto(double xTiles, double yTiles, MotionCallback onDone, void *ctx, TickType_t timeout);
+
+/*
+ * Current head position in orthogonal steps from home, updated by every move including aborted
+ * ones. Returns false until homing has succeeded.
+ */
+bool motionGetPosition(int32_t *xSteps, int32_t *ySteps);
+
+/*
+ * Called from the motion task as each command starts, with the ctx it was queued with and a result
+ * holding only its id and type. Must not block for long.
+ */
+void motionSetStartCallback(MotionCallback onStart);
+
+/*
+ * Change how long the drivers stay awake once the queue runs dry. 0 sleeps them right after the
+ * last command. Takes effect from the next command on.
+ */
+void motionSetIdleTimeout(uint32_t timeoutMs);
+
+/*
+ * Whether the magnet is switched on, and so a piece is being carried. Safe to call from any task.
+ */
+bool motionMagnetOn();
+
+/*
+ * Snapshot of the move being driven right now. Returns false while no move is running or the
+ * position is unknown. Safe to call from any task.
+ */
+bool motionGetProgress(MotionProgress *progress);
+
+/*
+ * Stop the move being driven right now, if any, as a limit switch would. It finishes with
+ * MOTION_ABORTED and the commands queued after it still run.
+ */
+void motionAbortMove();
+
+/*
+ * Square (a1 = 0 to h8 = 63) under a position in orthogonal steps from home, -1 off the board.
+ */
+int motionSquareAt(int32_t xSteps, int32_t ySteps);
+
+/*
+ * Block until every queued command has finished. Returns false on timeout.
+ */
+bool motionWaitIdle(TickType_t timeout);
+
+#endif //ESP32_BOARDCODE_MOTION_H
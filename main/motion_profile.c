@@ -0,0 +1,42 @@
+#include "motion_profile.h"
+
+const MotionProfile motionProfiles[PROFILE_COUNT] = {
+        [PROFILE_ORTHOGONAL] = {
+                .start_freq_hz = 5000,
+                .cruise_freq_hz = 50000,
+                .ramp_steps = 800,
+        },
+        [PROFILE_DIAGONAL] = {
+                .start_freq_hz = 5000,
+                .cruise_freq_hz = 40000,
+                .ramp_steps = 800,
+        },
+        [PROFILE_HOMING] = {
+                .start_freq_hz = 5000,
+                .cruise_freq_hz = 30000,
+                .ramp_steps = 400,
+        },
+};
+
+MovePlan planMove(const MotionProfile *profile, uint32_t totalSteps) {
+    MovePlan plan = {0};
+
+    if (totalSteps >= 2 * profile->ramp_steps) {
+        plan.accelSteps = profile->ramp_steps;
+        plan.decelSteps = profile->ramp_steps;
+        plan.cruiseSteps = totalSteps - 2 * profile->ramp_steps;
+    } else {
+        // Both ramps stop at the same point of the curve, the odd step goes to the acceleration
+        plan.decelSteps = totalSteps / 2;
+        plan.accelSteps = totalSteps - plan.decelSteps;
+    }
+    return plan;
+}
+
+uint32_t chunkCount(uint32_t totalSteps, uint32_t maxChunkSteps) {
+    return totalSteps / maxChunkSteps + (totalSteps % maxChunkSteps != 0);
+}
+
+uint32_t chunkSteps(uint32_t totalSteps, uint32_t chunks, uint32_t index) {
+    return totalSteps / chunks + (index < totalSteps % chunks);
+}
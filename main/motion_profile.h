@@ -0,0 +1,52 @@
+#ifndef ESP32_BOARDCODE_MOTION_PROFILE_H
+#define ESP32_BOARDCODE_MOTION_PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * Speed profile used for one kind of move. The acceleration and deceleration
+ * ramps are smoothstep curves from start_freq_hz to cruise_freq_hz that are
+ * ramp_steps long; whatever is left of the move runs at cruise_freq_hz.
+ */
+typedef struct {
+    uint32_t start_freq_hz;
+    uint32_t cruise_freq_hz;
+    uint32_t ramp_steps;  // Note: cruise_freq_hz - start_freq_hz >= ramp_steps
+} MotionProfile;
+
+typedef enum {
+    PROFILE_ORTHOGONAL = 0,
+    PROFILE_DIAGONAL = 1,
+    PROFILE_HOMING = 2,
+
+    PROFILE_COUNT
+} MotionProfileType;
+
+/* Steps spent in each phase of a move, they always add up to the requested total. */
+typedef struct {
+    uint32_t accelSteps;
+    uint32_t cruiseSteps;
+    uint32_t decelSteps;
+} MovePlan;
+
+extern const MotionProfile motionProfiles[PROFILE_COUNT];
+
+/*
+ * Split totalSteps into accelerate, cruise and decelerate phases. Moves too short
+ * to reach cruise speed get a truncated, symmetric ramp and no cruise phase.
+ * Has no ESP-IDF dependencies so it can be built on the host.
+ */
+MovePlan planMove(const MotionProfile *profile, uint32_t totalSteps);
+
+/*
+ * Number of chunks of at most maxChunkSteps needed to cover totalSteps.
+ */
+uint32_t chunkCount(uint32_t totalSteps, uint32_t maxChunkSteps);
+
+/*
+ * Steps in chunk index of totalSteps split into chunks as evenly as possible. The chunks differ
+ * by at most one step and always add up to totalSteps exactly.
+ */
+uint32_t chunkSteps(uint32_t totalSteps, uint32_t chunks, uint32_t index);
+
+#endif //ESP32_BOARDCODE_MOTION_PROFILE_H
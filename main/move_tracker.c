@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "move_tracker.h"
+
+#define SQUARE_BIT(square) (1ULL << (square))
+#define FILE_OF(square) ((square) % 8)
+#define RANK_OF(square) ((square) / 8)
+
+typedef struct {
+    uint8_t kingFrom;
+    uint8_t kingTo;
+    uint8_t rookFrom;
+    uint8_t rookTo;
+} Castling;
+
+static const Castling castlings[] = {
+        {4, 6, 7, 5},      // e1g1
+        {4, 2, 0, 3},      // e1c1
+        {60, 62, 63, 61},  // e8g8
+        {60, 58, 56, 59},  // e8c8
+};
+
+#define CASTLING_COUNT (sizeof(castlings) / sizeof(castlings[0]))
+
+static int countSquares(uint64_t squares) {
+    return __builtin_popcountll(squares);
+}
+
+static uint8_t firstSquare(uint64_t squares) {
+    return __builtin_ctzll(squares);
+}
+
+static const Castling *castlingForKing(uint8_t from, uint8_t to) {
+    for (size_t i = 0; i < CASTLING_COUNT; i++) {
+        if (castlings[i].kingFrom == from && castlings[i].kingTo == to) {
+            return &castlings[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * The pawn on from took the one on captured en passant if they stood side by side on the fifth
+ * rank of the taking side and it went to the square behind the taken pawn.
+ */
+static bool isEnPassant(uint8_t from, uint8_t captured, uint8_t to) {
+    if (RANK_OF(from) != RANK_OF(captured) || abs(FILE_OF(from) - FILE_OF(captured)) != 1) {
+        return false;
+    }
+    if (RANK_OF(from) == 4) {
+        return to == captured + 8;
+    }
+    return RANK_OF(from) == 3 && to == captured - 8;
+}
+
+/*
+ * Match the difference from the settled board against the patterns of a finished move. Returns
+ * false while the squares seen so far could still be a move in progress.
+ */
+static bool inferMove(const MoveTracker *tracker, uint64_t board, BoardMove *move) {
+    uint64_t removed = tracker->settled & ~board;
+    uint64_t added = board & ~tracker->settled;
+    int removedCount = countSquares(removed);
+    int addedCount = countSquares(added);
+
+    if (removedCount == 1 && addedCount == 1) {
+        *move = (BoardMove) {.from = firstSquare(removed), .to = firstSquare(added), .kind = MOVE_NORMAL};
+        return true;
+    }
+
+    if (removedCount == 1 && addedCount == 0) {
+        // The square the taken piece was lifted from is occupied again, now by the taking piece
+        uint64_t retaken = tracker->lifted & board;
+        if (countSquares(retaken) == 1) {
+            uint8_t to = firstSquare(retaken);
+            *move = (BoardMove) {.from = firstSquare(removed), .to = to, .captured = to, .kind = MOVE_CAPTURE};
+            return true;
+        }
+        // The pawn taken en passant, lifted after the taking pawn was already put down
+        const BoardMove *last = &tracker->last;
+        if (retaken == 0 && tracker->hasLast && !tracker->holding && last->kind == MOVE_NORMAL &&
+            isEnPassant(last->from, firstSquare(removed), last->to)) {
+            *move = (BoardMove) {
+                    .from = last->from,
+                    .to = last->to,
+                    .captured = firstSquare(removed),
+                    .kind = MOVE_EN_PASSANT,
+                    .corrects = true,
+            };
+            return true;
+        }
+        return false;
+    }
+
+    if (removedCount == 2 && addedCount == 1) {
+        uint8_t first = firstSquare(removed);
+        uint8_t second = firstSquare(removed & ~SQUARE_BIT(first));
+        uint8_t to = firstSquare(added);
+        if (isEnPassant(first, second, to)) {
+            *move = (BoardMove) {.from = first, .to = to, .captured = second, .kind = MOVE_EN_PASSANT};
+            return true;
+        }
+        if (isEnPassant(second, first, to)) {
+            *move = (BoardMove) {.from = second, .to = to, .captured = first, .kind = MOVE_EN_PASSANT};
+            return true;
+        }
+        return false;
+    }
+
+    if (removedCount == 2 && addedCount == 2) {
+        // King and rook moved together
+        for (size_t i = 0; i < CASTLING_COUNT; i++) {
+            const Castling *castling = &castlings[i];
+            if (removed == (SQUARE_BIT(castling->kingFrom) | SQUARE_BIT(castling->rookFrom)) &&
+                added == (SQUARE_BIT(castling->kingTo) | SQUARE_BIT(castling->rookTo))) {
+                *move = (BoardMove) {.from = castling->kingFrom, .to = castling->kingTo, .kind = MOVE_CASTLE};
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void moveTrackerReset(MoveTracker *tracker, uint64_t board) {
+    *tracker = (MoveTracker) {
+            .started = true,
+            .settled = board,
+            .board = board,
+    };
+}
+
+static void reportMove(MoveTracker *tracker, const BoardMove *move, BoardMove moves[MAX_MOVES_PER_UPDATE],
+                       int *count) {
+    moves[(*count)++] = *move;
+    tracker->last = *move;
+    tracker->hasLast = true;
+}
+
+/* Give up on the squares seen since the settled board and carry on from the latest one */
+static int resync(MoveTracker *tracker, int64_t timestampUs, BoardMove moves[MAX_MOVES_PER_UPDATE]) {
+    int count = 0;
+    if (tracker->holding) {
+        moves[count++] = tracker->held;
+        tracker->holding = false;
+    }
+    moves[count++] = (BoardMove) {.kind = MOVE_UNKNOWN, .timestampUs = timestampUs};
+    tracker->settled = tracker->board;
+    tracker->lifted = 0;
+    tracker->unmatched = 0;
+    tracker->hasLast = false;
+    return count;
+}
+
+int moveTrackerUpdate(MoveTracker *tracker, uint64_t board, int64_t timestampUs,
+                      BoardMove moves[MAX_MOVES_PER_UPDATE]) {
+    if (!tracker->started) {
+        moveTrackerReset(tracker, board);
+        return 0;
+    }
+
+    tracker->board = board;
+    tracker->changedUs = timestampUs;
+    tracker->lifted |= tracker->settled & ~board;
+    if (board == tracker->settled) {
+        // Whatever was lifted went back where it was
+        tracker->lifted = 0;
+        tracker->unmatched = 0;
+        return 0;
+    }
+
+    BoardMove move;
+    if (!inferMove(tracker, board, &move)) {
+        if (++tracker->unmatched >= MOVE_RESYNC_UPDATES) {
+            return resync(tracker, timestampUs, moves);
+        }
+        return 0;
+    }
+    move.timestampUs = timestampUs;
+    tracker->settled = board;
+    tracker->lifted = 0;
+    tracker->unmatched = 0;
+
+    int count = 0;
+    if (tracker->holding) {
+        tracker->holding = false;
+        const Castling *castling = castlingForKing(tracker->held.from, tracker->held.to);
+        if (move.kind == MOVE_NORMAL && move.from == castling->rookFrom && move.to == castling->rookTo) {
+            BoardMove castle = {
+                    .from = tracker->held.from,
+                    .to = tracker->held.to,
+                    .kind = MOVE_CASTLE,
+                    .timestampUs = timestampUs,
+            };
+            reportMove(tracker, &castle, moves, &count);
+            return count;
+        }
+        reportMove(tracker, &tracker->held, moves, &count);
+    }
+
+    const Castling *castling = move.kind == MOVE_NORMAL ? castlingForKing(move.from, move.to) : NULL;
+    if (castling && (board & SQUARE_BIT(castling->rookFrom)) && !(board & SQUARE_BIT(castling->rookTo))) {
+        tracker->held = move;
+        tracker->holding = true;
+        return count;
+    }
+    // The rook went first and was reported as a move of its own
+    const BoardMove *last = &tracker->last;
+    if (castling && count == 0 && tracker->hasLast && last->kind == MOVE_NORMAL &&
+        last->from == castling->rookFrom && last->to == castling->rookTo) {
+        move.kind = MOVE_CASTLE;
+        move.corrects = true;
+    }
+    reportMove(tracker, &move, moves, &count);
+    return count;
+}
+
+int moveTrackerRelease(MoveTracker *tracker, int64_t nowUs, BoardMove moves[MAX_MOVES_PER_UPDATE]) {
+    if (tracker->board != tracker->settled) {
+        // A piece in the hand may be the rook on its way, the held move waits for the resync then
+        if (nowUs - tracker->changedUs < MOVE_RESYNC_TIMEOUT_US) {
+            return 0;
+        }
+        return resync(tracker, nowUs, moves);
+    }
+    if (!tracker->holding || nowUs - tracker->held.timestampUs < MOVE_HOLD_TIMEOUT_US) {
+        return 0;
+    }
+    tracker->holding = false;
+    int count = 0;
+    reportMove(tracker, &tracker->held, moves, &count);
+    return count;
+}
+
+int64_t moveTrackerDeadline(const MoveTracker *tracker) {
+    if (tracker->board != tracker->settled) {
+        return tracker->changedUs + MOVE_RESYNC_TIMEOUT_US;
+    }
+    if (tracker->holding) {
+        return tracker->held.timestampUs + MOVE_HOLD_TIMEOUT_US;
+    }
+    return -1;
+}
+
+void moveToString(const BoardMove *move, char str[MOVE_STRING_LENGTH]) {
+    if (move->kind == MOVE_UNKNOWN) {
+        snprintf(str, MOVE_STRING_LENGTH, "0000");
+        return;
+    }
+    str[0] = (char) ('a' + FILE_OF(move->from));
+    str[1] = (char) ('1' + RANK_OF(move->from));
+    str[2] = (char) ('a' + FILE_OF(move->to));
+    str[3] = (char) ('1' + RANK_OF(move->to));
+    str[4] = '\0';
+}
+
+const char *moveKindName(MoveKind kind) {
+    switch (kind) {
+        case MOVE_CAPTURE:
+            return "capture";
+        case MOVE_CASTLE:
+            return "castle";
+        case MOVE_EN_PASSANT:
+            return "enpassant";
+        case MOVE_UNKNOWN:
+            return "unknown";
+        default:
+            return "move";
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef ESP32_BOARDCODE_MOVE_TRACKER_H
+#define ESP32_BOARDCODE_MOVE_TRACKER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Most moves one board update can complete: a held back king move and the move after it
+#define MAX_MOVES_PER_UPDATE 2
+// "e7e8" plus the terminator
+#define MOVE_STRING_LENGTH 5
+// How long a held back king move waits for its rook before it is reported on its own
+#define MOVE_HOLD_TIMEOUT_US 3000000
+// A board that matches no move is taken as the new position after this long without a change...
+#define MOVE_RESYNC_TIMEOUT_US 20000000
+// ...or after this many changes, a capture or castling passes through at most three
+#define MOVE_RESYNC_UPDATES 6
+
+typedef enum {
+    MOVE_NORMAL,
+    MOVE_CAPTURE,
+    MOVE_CASTLE,  // from/to are the king's squares
+    MOVE_EN_PASSANT,
+    MOVE_UNKNOWN,  // The board stopped matching any move and was taken as it is, from/to are unset
+} MoveKind;
+
+/* Squares are numbered like the bitboards, a1 = 0 to h8 = 63 */
+typedef struct {
+    uint8_t from;
+    uint8_t to;
+    uint8_t captured;  // Square the taken piece stood on, only for MOVE_CAPTURE and MOVE_EN_PASSANT
+    MoveKind kind;
+    bool corrects;  // Replaces the move reported just before, which turned out to be half of this one
+    int64_t timestampUs;  // Time of the board update that completed the move
+} BoardMove;
+
+/*
+ * Works out moves from successive occupancy bitboards. Between two settled positions it remembers
+ * every square that was lifted, so a capture (lift the taken piece, lift the moving one, place it
+ * on the emptied square) can be told from a piece lifted and put back.
+ */
+typedef struct {
+    bool started;
+    uint64_t settled;  // Board after the last completed move
+    uint64_t lifted;   // Squares emptied at some point since then
+    uint64_t board;    // Latest board
+    int64_t changedUs;  // When the latest board came in
+    int unmatched;     // Changes since the settled board that matched no move
+    bool holding;      // A king move that may turn out to be castling is held back in held
+    BoardMove held;
+    bool hasLast;      // The last move reported is in last, for the other half of it to correct
+    BoardMove last;
+} MoveTracker;
+
+/*
+ * Start tracking from board, forgetting anything in progress.
+ */
+void moveTrackerReset(MoveTracker *tracker, uint64_t board);
+
+/*
+ * Feed the next debounced board. Returns how many moves it completed, written to moves. The first
+ * board only starts tracking.
+ *
+ * A king moving two squares from its start square is held back until the next move: if that is
+ * the matching rook it is reported as castling, otherwise both are reported as they were. A held
+ * move that nothing follows is released by moveTrackerRelease().
+ *
+ * Castling with the rook first and en passant with the taken pawn lifted last look like a normal
+ * move at first. The change that finishes them reports the whole move with corrects set.
+ *
+ * A board that matches no move for MOVE_RESYNC_UPDATES changes, say a piece knocked over, is taken
+ * as the settled board and reported as a MOVE_UNKNOWN, so tracking carries on from there.
+ */
+int moveTrackerUpdate(MoveTracker *tracker, uint64_t board, int64_t timestampUs,
+                      BoardMove moves[MAX_MOVES_PER_UPDATE]);
+
+/*
+ * Report what waiting has settled, returning how many moves were written to moves:
+ *  - a held king move once it is MOVE_HOLD_TIMEOUT_US old and no piece is lifted, so a piece that
+ *    only moved like a castling king doesn't stall the game. The rook moving afterwards is then
+ *    reported as a move of its own.
+ *  - a MOVE_UNKNOWN once a board matching no move went MOVE_RESYNC_TIMEOUT_US without a change,
+ *    after the held move if there is one.
+ */
+int moveTrackerRelease(MoveTracker *tracker, int64_t nowUs, BoardMove moves[MAX_MOVES_PER_UPDATE]);
+
+/*
+ * When moveTrackerRelease() may next report something, in the time base of the updates, or -1 if
+ * nothing is waiting.
+ */
+int64_t moveTrackerDeadline(const MoveTracker *tracker);
+
+/*
+ * Long algebraic notation of a move as used by UCI, e.g. "e2e4" or "e1g1" for castling, and the UCI
+ * null move "0000" for MOVE_UNKNOWN.
+ */
+void moveToString(const BoardMove *move, char str[MOVE_STRING_LENGTH]);
+
+const char *moveKindName(MoveKind kind);
+
+#endif //ESP32_BOARDCODE_MOVE_TRACKER_H
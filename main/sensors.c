@@ -0,0 +1,722 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "motion.h"
+#include "nvs.h"
+#include "sensors.h"
+
+#define TAG_SENSORS "SENSORS"
+
+#define GPIO_OUTPUT_MUX_SEL ((1ULL << MUX_RST) | (1ULL << MUX_CLK))
+#define GPIO_INPUT_SENSOR_SEL (1ULL << SENSOR_ARRAY)
+
+#define SQUARE_COUNT 64
+#define BOARD_BYTES (SQUARE_COUNT / 8)
+#define SCAN_TIMER_RESOLUTION_HZ 1000000
+// Timer steps of a pass: four to reset the mux, then a falling and a rising clock edge per square
+#define MUX_RESET_STEPS 4
+#define PASS_STEPS(squares) (MUX_RESET_STEPS + 2 * (squares))
+#define ALL_SQUARES (~0ULL)
+// Passes that must all match the reference before a settle time is accepted
+#define CALIBRATION_SAMPLES SENSOR_MAX_SAMPLES
+
+// Watch reads in a row that must show the same stray square before a move is stopped
+#define CARRY_CONFIRM_READS 2
+// Points along a move checked for the squares it crosses
+#define PATH_SAMPLES 64
+
+#define SENSOR_NVS_NAMESPACE "sensors"
+#define SENSOR_NVS_MAP_KEY "map"
+#define SENSOR_NVS_INVERT_KEY "invert"
+
+// Square (1 based, a1 = 1) behind every mux output, in clock order, on the original board
+static const uint8_t positions[SQUARE_COUNT] = {
+        49,
+        51,
+        55,
+        53,
+        57,
+        59,
+        61,
+        63,
+        64,
+        62,
+        60,
+        58,
+        56,
+        54,
+        52,
+        50,
+        33,
+        35,
+        37,
+        39,
+        41,
+        43,
+        45,
+        47,
+        48,
+        46,
+        44,
+        42,
+        40,
+        38,
+        36,
+        34,
+        17,
+        19,
+        21,
+        23,
+        25,
+        27,
+        29,
+        31,
+        32,
+        30,
+        28,
+        26,
+        24,
+        22,
+        20,
+        18,
+        1,
+        3,
+        5,
+        7,
+        9,
+        11,
+        13,
+        15,
+        16,
+        14,
+        12,
+        10,
+        8,
+        6,
+        4,
+        2
+
+};
+
+// Alarms closer than the mux clock half period come faster than the scan timer interrupt is served
+static const uint32_t calibrationSettleUs[] = {SENSOR_CLOCK_HALF_PERIOD_US, 10, 20, 50, 100, 200, 500};
+
+typedef struct {
+    uint32_t settleUs;
+    int squares;  // Mux outputs clocked through per pass
+    // Raw samples, bit i is mux output i
+    int step;
+    int steps;
+    uint64_t passes[SENSOR_MAX_SAMPLES];
+} ScanState;
+
+static volatile uint32_t sensorSettleUs = SENSOR_DEFAULT_SETTLE_US;
+static portMUX_TYPE debounceLock = portMUX_INITIALIZER_UNLOCKED;
+static DebounceConfig debounce = {
+        .rule = DEBOUNCE_MAJORITY,
+        .samples = 3,
+        .stableSamples = 2,
+};
+
+static gptimer_handle_t scanTimer = NULL;
+static SemaphoreHandle_t scanDone = NULL;
+static SemaphoreHandle_t scanLock = NULL;
+static ScanState scan;
+
+// Square (a1 = 0) behind every mux output, and the squares whose sensor reads the other way round
+static uint8_t squareMap[SQUARE_COUNT];
+static uint64_t invertedSquares = 0;
+// Squares behind every value of every byte of a raw sample, rebuilt with the map
+static uint64_t mapTables[BOARD_BYTES][256];
+
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+static SquareStats squareStats[SQUARE_COUNT];
+static int64_t lastFlipUs[SQUARE_COUNT];
+// Squares whose share of disagreeing reads passed SENSOR_NOISY_PER_MILLE
+static uint64_t noisySquares = 0;
+
+typedef struct {
+    bool active;
+    MotionProgress move;  // Only the start and end are compared
+    uint64_t before;      // Board when the move started
+    uint64_t path;        // Squares the move crosses
+    uint64_t suspects;
+    int suspectReads;
+    bool reported;
+} CarryWatch;
+
+static BoardChangedCallback boardChanged = NULL;
+static CarryLostCallback carryLost = NULL;
+static TaskHandle_t scannerTaskHandle = NULL;
+static portMUX_TYPE scanRatesLock = portMUX_INITIALIZER_UNLOCKED;
+static ScanRates scanRates = {
+        .activeMs = SCANNER_ACTIVE_PERIOD_MS,
+        .idleMs = SCANNER_IDLE_PERIOD_MS,
+        .motionMs = SCANNER_MOTION_PERIOD_MS,
+        .activeHoldMs = SCANNER_ACTIVE_HOLD_MS,
+};
+static volatile bool humanTurn = false;
+static volatile uint64_t scannedBoard = 0;
+
+/*
+ * Drives a read from the timer alarm: every pass resets the mux and clocks it through the first
+ * scan.squares outputs, and just before each falling edge samples the square the mux has been
+ * showing for the settle time. The alarm for the following step is moved on from this one, so
+ * edges stay on the timer's clock whatever the CPUs are busy with.
+ */
+static bool IRAM_ATTR onScanAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) {
+    int passSteps = PASS_STEPS(scan.squares);
+    int pass = scan.step / passSteps;
+    int step = scan.step++ % passSteps;
+    uint32_t delayUs = SENSOR_CLOCK_HALF_PERIOD_US;
+    if (step < MUX_RESET_STEPS) {
+        switch (step) {
+            case 0:
+                gpio_set_level(MUX_CLK, 0);
+                break;
+            case 1:
+                gpio_set_level(MUX_CLK, 1);
+                break;
+            case 2:
+                gpio_set_level(MUX_RST, 1);
+                break;
+            default:
+                gpio_set_level(MUX_RST, 0);
+                delayUs = scan.settleUs;
+                break;
+        }
+    } else {
+        int edge = step - MUX_RESET_STEPS;
+        if (edge % 2 == 0) {
+            scan.passes[pass] |= (uint64_t) !gpio_get_level(SENSOR_ARRAY) << (edge / 2);
+            gpio_set_level(MUX_CLK, 0);
+        } else {
+            gpio_set_level(MUX_CLK, 1);
+            delayUs = scan.settleUs;
+        }
+    }
+
+    if (scan.step == scan.steps) {
+        BaseType_t highTaskWakeup = pdFALSE;
+        gptimer_stop(timer);
+        xSemaphoreGiveFromISR(scanDone, &highTaskWakeup);
+        return highTaskWakeup == pdTRUE;
+    }
+    gptimer_alarm_config_t alarm_config = {
+            .alarm_count = edata->alarm_value + delayUs,
+    };
+    gptimer_set_alarm_action(timer, &alarm_config);
+    return false;
+}
+
+static void buildMapTables() {
+    for (int byte = 0; byte < BOARD_BYTES; byte++) {
+        for (int value = 0; value < 256; value++) {
+            uint64_t squares = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                if (value & (1 << bit)) {
+                    squares |= 1ULL << squareMap[8 * byte + bit];
+                }
+            }
+            mapTables[byte][value] = squares;
+        }
+    }
+}
+
+/*
+ * Turn a raw sample in mux order into a board, one table lookup per byte.
+ */
+static uint64_t mapRawSample(uint64_t raw) {
+    uint64_t board = 0;
+    for (int byte = 0; byte < BOARD_BYTES; byte++) {
+        board |= mapTables[byte][(raw >> 8 * byte) & 0xFF];
+    }
+    return board ^ invertedSquares;
+}
+
+static bool isPermutation(const uint8_t map[SQUARE_COUNT]) {
+    uint64_t seen = 0;
+    for (int i = 0; i < SQUARE_COUNT; i++) {
+        if (map[i] >= SQUARE_COUNT) {
+            return false;
+        }
+        seen |= 1ULL << map[i];
+    }
+    return seen == ~0ULL;
+}
+
+/*
+ * Use the map and inversion mask stored for this board, or the original board's map without
+ * inversions where there is none.
+ */
+static void loadSensorMap() {
+    for (int i = 0; i < SQUARE_COUNT; i++) {
+        squareMap[i] = positions[i] - 1;
+    }
+    invertedSquares = 0;
+
+    nvs_handle_t nvs;
+    if (nvs_open(SENSOR_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        uint8_t map[SQUARE_COUNT];
+        size_t length = sizeof(map);
+        if (nvs_get_blob(nvs, SENSOR_NVS_MAP_KEY, map, &length) == ESP_OK) {
+            if (length == sizeof(map) && isPermutation(map)) {
+                memcpy(squareMap, map, sizeof(map));
+                ESP_LOGI(TAG_SENSORS, "Loaded sensor map from NVS");
+            } else {
+                ESP_LOGE(TAG_SENSORS, "Invalid sensor map in NVS, using the default one");
+            }
+        }
+        nvs_get_u64(nvs, SENSOR_NVS_INVERT_KEY, &invertedSquares);
+        nvs_close(nvs);
+    }
+    buildMapTables();
+}
+
+void setupSensors() {
+    gpio_config_t io_config = {
+            .pin_bit_mask = GPIO_OUTPUT_MUX_SEL,
+            .intr_type = GPIO_INTR_DISABLE,
+            .mode = GPIO_MODE_OUTPUT,
+            .pull_down_en = 0,
+            .pull_up_en = 0};
+    gpio_config(&io_config);
+
+    io_config.pin_bit_mask = GPIO_INPUT_SENSOR_SEL;
+    io_config.mode = GPIO_MODE_INPUT;
+    gpio_config(&io_config);
+
+    scanDone = xSemaphoreCreateBinary();
+    scanLock = xSemaphoreCreateMutex();
+    loadSensorMap();
+
+    ESP_LOGI(TAG_SENSORS, "Create sensor scan timer");
+    gptimer_config_t timer_config = {
+            .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+            .direction = GPTIMER_COUNT_UP,
+            .resolution_hz = SCAN_TIMER_RESOLUTION_HZ,
+    };
+    ESP_ERROR_CHECK(gptimer_new_timer(&timer_config, &scanTimer));
+    gptimer_event_callbacks_t callbacks = {
+            .on_alarm = onScanAlarm,
+    };
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(scanTimer, &callbacks, NULL));
+    ESP_ERROR_CHECK(gptimer_enable(scanTimer));
+}
+
+/*
+ * Mux outputs to clock through before every square in mask has been seen. The mux only counts up
+ * from reset, so that is one past the last of them in clock order.
+ */
+static int muxSquaresFor(uint64_t mask) {
+    int squares = 0;
+    for (int i = 0; i < SQUARE_COUNT; i++) {
+        if (mask & (1ULL << squareMap[i])) {
+            squares = i + 1;
+        }
+    }
+    return squares;
+}
+
+/*
+ * Sample the squares in mask in the given number of passes, timed by the scan timer. Squares past
+ * the last requested one in clock order are skipped, others on the way may be sampled as well. The
+ * calling task sleeps until the last edge.
+ */
+static void scanBoard(uint32_t settleUs, uint64_t mask, int passes, uint64_t samples[]) {
+    xSemaphoreTake(scanLock, portMAX_DELAY);
+    int squares = muxSquaresFor(mask);
+    if (squares == 0) {
+        memset(samples, 0, passes * sizeof(samples[0]));
+        xSemaphoreGive(scanLock);
+        return;
+    }
+
+    scan = (ScanState) {
+            .settleUs = settleUs,
+            .squares = squares,
+            .steps = passes * PASS_STEPS(squares),
+    };
+    gptimer_alarm_config_t alarm_config = {
+            .alarm_count = 1,
+    };
+    ESP_ERROR_CHECK(gptimer_set_raw_count(scanTimer, 0));
+    ESP_ERROR_CHECK(gptimer_set_alarm_action(scanTimer, &alarm_config));
+    ESP_ERROR_CHECK(gptimer_start(scanTimer));
+    xSemaphoreTake(scanDone, portMAX_DELAY);
+
+    for (int i = 0; i < passes; i++) {
+        samples[i] = mapRawSample(scan.passes[i]);
+    }
+    xSemaphoreGive(scanLock);
+}
+
+static bool samplesAgree(const uint64_t samples[], int count, uint64_t board) {
+    for (int i = 0; i < count; i++) {
+        if (samples[i] != board) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Fold the samples of a read into one board. Squares set in confident had every sample that the
+ * rule looks at agree on the returned value.
+ */
+static uint64_t debounceSamples(const DebounceConfig *config, const uint64_t samples[], uint64_t *confident,
+                                uint64_t *unanimousSquares) {
+    uint64_t board = 0;
+    uint64_t unanimous = 0;
+    for (int square = 0; square < SQUARE_COUNT; square++) {
+        int occupied = 0;
+        for (int i = 0; i < config->samples; i++) {
+            occupied += (samples[i] >> square) & 1;
+        }
+        if (2 * occupied > config->samples) {
+            board |= 1ULL << square;
+        }
+        if (occupied == 0 || occupied == config->samples) {
+            unanimous |= 1ULL << square;
+        }
+    }
+    *unanimousSquares = unanimous;
+    if (config->rule == DEBOUNCE_MAJORITY) {
+        *confident = unanimous;
+        return board;
+    }
+
+    // Bits where the last stableSamples samples all agree with the newest one
+    const uint64_t *recent = &samples[config->samples - config->stableSamples];
+    uint64_t stable = ~0ULL;
+    for (int i = 0; i < config->stableSamples; i++) {
+        stable &= ~(recent[i] ^ samples[config->samples - 1]);
+    }
+    *confident = stable;
+    return (samples[config->samples - 1] & stable) | (board & ~stable);
+}
+
+static bool isNoisy(const SquareStats *stats) {
+    return stats->reads >= SENSOR_NOISY_MIN_READS &&
+           (uint64_t) stats->disagreements * 1000 > (uint64_t) stats->reads * SENSOR_NOISY_PER_MILLE;
+}
+
+static void countReads(uint64_t mask, uint64_t unanimous) {
+    portENTER_CRITICAL(&statsLock);
+    for (int square = 0; square < SQUARE_COUNT; square++) {
+        if (mask & (1ULL << square)) {
+            SquareStats *stats = &squareStats[square];
+            stats->reads++;
+            stats->disagreements += !(unanimous & (1ULL << square));
+            if (isNoisy(stats)) {
+                noisySquares |= 1ULL << square;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&statsLock);
+}
+
+static void countFlips(uint64_t changed, int64_t nowUs) {
+    portENTER_CRITICAL(&statsLock);
+    for (int square = 0; square < SQUARE_COUNT; square++) {
+        if (changed & (1ULL << square)) {
+            squareStats[square].flips++;
+            lastFlipUs[square] = nowUs;
+        }
+    }
+    portEXIT_CRITICAL(&statsLock);
+}
+
+void sensorsGetStats(SquareStats stats[SQUARE_COUNT]) {
+    int64_t nowUs = esp_timer_get_time();
+    portENTER_CRITICAL(&statsLock);
+    for (int square = 0; square < SQUARE_COUNT; square++) {
+        stats[square] = squareStats[square];
+        stats[square].stableMs = (nowUs - lastFlipUs[square]) / 1000;
+    }
+    portEXIT_CRITICAL(&statsLock);
+}
+
+void sensorsResetStats() {
+    portENTER_CRITICAL(&statsLock);
+    memset(squareStats, 0, sizeof(squareStats));
+    noisySquares = 0;
+    portEXIT_CRITICAL(&statsLock);
+}
+
+uint64_t readSquares(uint64_t mask, uint64_t *confident) {
+    uint64_t samples[SENSOR_MAX_SAMPLES];
+    uint64_t confidentSquares;
+    portENTER_CRITICAL(&debounceLock);
+    DebounceConfig config = debounce;
+    portEXIT_CRITICAL(&debounceLock);
+
+    int64_t startUs = esp_timer_get_time();
+    scanBoard(sensorSettleUs, mask, config.samples, samples);
+    uint64_t unanimous;
+    uint64_t board = debounceSamples(&config, samples, &confidentSquares, &unanimous) & mask;
+    countReads(mask, unanimous);
+    ESP_LOGD(TAG_SENSORS, "Squares 0x%" PRIx64 " of 0x%" PRIx64 " (confident 0x%" PRIx64 ") read in %" PRId64 " us",
+             board, mask, confidentSquares, esp_timer_get_time() - startUs);
+    if (confident) {
+        *confident = confidentSquares & mask;
+    }
+    return board;
+}
+
+uint64_t readSensors(uint64_t *confident) {
+    return readSquares(ALL_SQUARES, confident);
+}
+
+bool sensorsSetDebounce(const DebounceConfig *config) {
+    if (config->samples < 1 || config->samples > SENSOR_MAX_SAMPLES ||
+        (config->rule == DEBOUNCE_STABLE && (config->stableSamples < 1 || config->stableSamples > config->samples))) {
+        return false;
+    }
+    portENTER_CRITICAL(&debounceLock);
+    debounce = *config;
+    portEXIT_CRITICAL(&debounceLock);
+    return true;
+}
+
+bool sensorsSetMap(const uint8_t map[SQUARE_COUNT], uint64_t inverted) {
+    if (!isPermutation(map)) {
+        return false;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SENSOR_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, SENSOR_NVS_MAP_KEY, map, SQUARE_COUNT);
+        if (err == ESP_OK) {
+            err = nvs_set_u64(nvs, SENSOR_NVS_INVERT_KEY, inverted);
+        }
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_SENSORS, "Storing the sensor map failed: %s", esp_err_to_name(err));
+    }
+
+    // Applies right away even if it could not be stored
+    xSemaphoreTake(scanLock, portMAX_DELAY);
+    memcpy(squareMap, map, SQUARE_COUNT);
+    invertedSquares = inverted;
+    buildMapTables();
+    xSemaphoreGive(scanLock);
+    return true;
+}
+
+void sensorsSetSettleTime(uint32_t settleUs) {
+    sensorSettleUs = settleUs;
+}
+
+uint32_t sensorsGetSettleTime() {
+    return sensorSettleUs;
+}
+
+uint32_t sensorsCalibrate() {
+    uint64_t samples[CALIBRATION_SAMPLES];
+    scanBoard(SENSOR_MAX_SETTLE_US, ALL_SQUARES, CALIBRATION_SAMPLES, samples);
+    uint64_t reference = samples[0];
+    if (!samplesAgree(samples, CALIBRATION_SAMPLES, reference)) {
+        ESP_LOGW(TAG_SENSORS, "Board not stable, keeping settle time of %" PRIu32 " us", sensorSettleUs);
+        return sensorSettleUs;
+    }
+    if (reference == 0) {
+        // Empty squares read the same however short the settle time is
+        ESP_LOGW(TAG_SENSORS, "Board empty, keeping settle time of %" PRIu32 " us", sensorSettleUs);
+        return sensorSettleUs;
+    }
+
+    for (int i = 0; i < sizeof(calibrationSettleUs) / sizeof(calibrationSettleUs[0]); i++) {
+        scanBoard(calibrationSettleUs[i], ALL_SQUARES, CALIBRATION_SAMPLES, samples);
+        if (samplesAgree(samples, CALIBRATION_SAMPLES, reference)) {
+            // Leave a margin for temperature and supply drift
+            sensorSettleUs = 2 * calibrationSettleUs[i];
+            break;
+        }
+    }
+    ESP_LOGI(TAG_SENSORS, "Settle time calibrated to %" PRIu32 " us", sensorSettleUs);
+    return sensorSettleUs;
+}
+
+static uint64_t pathSquares(const MotionProgress *move) {
+    uint64_t path = 0;
+    for (int i = 0; i <= PATH_SAMPLES; i++) {
+        int square = motionSquareAt(move->fromX + (int64_t) (move->toX - move->fromX) * i / PATH_SAMPLES,
+                                    move->fromY + (int64_t) (move->toY - move->fromY) * i / PATH_SAMPLES);
+        if (square >= 0) {
+            path |= 1ULL << square;
+        }
+    }
+    return path;
+}
+
+static uint64_t squaresAround(int square) {
+    uint64_t around = 0;
+    if (square < 0) {
+        return around;
+    }
+    for (int rank = square / 8 - 1; rank <= square / 8 + 1; rank++) {
+        for (int file = square % 8 - 1; file <= square % 8 + 1; file++) {
+            if (rank >= 0 && rank < 8 && file >= 0 && file < 8) {
+                around |= 1ULL << (rank * 8 + file);
+            }
+        }
+    }
+    return around;
+}
+
+/*
+ * One read of the squares a carried piece crosses. Away from the head, a square that was empty
+ * before the move must stay empty, and the start square must have been emptied by the magnet.
+ * Anything else seen in a few reads in a row stops the move.
+ */
+static void watchCarry(CarryWatch *watch, const MotionProgress *move, uint64_t board) {
+    if (!watch->active || watch->move.fromX != move->fromX || watch->move.fromY != move->fromY ||
+        watch->move.toX != move->toX || watch->move.toY != move->toY) {
+        *watch = (CarryWatch) {
+                .active = true,
+                .move = *move,
+                .before = board,
+                .path = pathSquares(move),
+        };
+    }
+    if (watch->reported) {
+        return;
+    }
+
+    uint64_t nearHead = squaresAround(motionSquareAt(move->headX, move->headY));
+    int from = motionSquareAt(move->fromX, move->fromY);
+    uint64_t path = readSquares(watch->path, NULL);
+    uint64_t stray = path & ~watch->before & ~nearHead;
+    if (from >= 0 && (path & (1ULL << from)) && !(nearHead & (1ULL << from))) {
+        stray |= 1ULL << from;
+    }
+
+    if (!stray) {
+        watch->suspectReads = 0;
+        return;
+    }
+    if (stray & watch->suspects) {
+        watch->suspectReads++;
+        watch->suspects &= stray;
+    } else {
+        watch->suspects = stray;
+        watch->suspectReads = 1;
+    }
+    if (watch->suspectReads >= CARRY_CONFIRM_READS) {
+        ESP_LOGW(TAG_SENSORS, "Carried piece lost, squares 0x%016" PRIx64, watch->suspects);
+        motionAbortMove();
+        watch->reported = true;
+        if (carryLost) {
+            carryLost(watch->suspects);
+        }
+    }
+}
+
+/*
+ * Time until the next read: back off while the motors run empty or nothing happens, and read at
+ * the active rate while a piece is carried, during the human's turn or shortly after the board
+ * changed.
+ */
+static uint32_t nextScanPeriodMs(int64_t lastChangeUs) {
+    portENTER_CRITICAL(&scanRatesLock);
+    ScanRates rates = scanRates;
+    portEXIT_CRITICAL(&scanRatesLock);
+
+    if (!motionWaitIdle(0)) {
+        // Carried moves are queued back to back, catch the start of each one
+        return motionMagnetOn() ? rates.activeMs : rates.motionMs;
+    }
+    if (humanTurn || esp_timer_get_time() - lastChangeUs < (int64_t) rates.activeHoldMs * 1000) {
+        return rates.activeMs;
+    }
+    return rates.idleMs;
+}
+
+static void scannerTask(void *arg) {
+    uint64_t last = 0;
+    bool first = true;
+    int64_t lastChangeUs = 0;
+    CarryWatch watch = {0};
+    for (;;) {
+        MotionProgress move;
+        if (!first && motionGetProgress(&move) && move.magnetOn) {
+            watchCarry(&watch, &move, last);
+            portENTER_CRITICAL(&scanRatesLock);
+            uint32_t periodMs = scanRates.activeMs;
+            portEXIT_CRITICAL(&scanRatesLock);
+            vTaskDelay(pdMS_TO_TICKS(periodMs));
+            continue;
+        }
+        watch.active = false;
+
+        uint64_t confident;
+        uint64_t board = readSensors(&confident);
+        // Noisy squares keep their last value until they settle elsewhere, others follow the debounce
+        portENTER_CRITICAL(&statsLock);
+        uint64_t accepted = confident | ~noisySquares;
+        portEXIT_CRITICAL(&statsLock);
+        board = (board & accepted) | (last & ~accepted);
+        uint64_t changed = board ^ last;
+        if (changed || first) {
+            lastChangeUs = esp_timer_get_time();
+            if (!first) {
+                countFlips(changed, lastChangeUs);
+            }
+            scannedBoard = board;
+            last = board;
+            first = false;
+            ESP_LOGI(TAG_SENSORS, "Board 0x%016" PRIx64 ", changed 0x%016" PRIx64, board, changed);
+            if (boardChanged) {
+                boardChanged(board, changed);
+            }
+        }
+        // A turn change or a carried move starting wakes the scanner early
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(nextScanPeriodMs(lastChangeUs)));
+    }
+}
+
+void startBoardScanner(BoardChangedCallback onChanged, CarryLostCallback onCarryLost) {
+    boardChanged = onChanged;
+    carryLost = onCarryLost;
+    xTaskCreatePinnedToCore(scannerTask, "scanner", SCANNER_TASK_STACK_SIZE, NULL, SCANNER_TASK_PRIORITY,
+                            &scannerTaskHandle, SCANNER_TASK_CORE);
+}
+
+void sensorsSetScanRates(const ScanRates *rates) {
+    portENTER_CRITICAL(&scanRatesLock);
+    scanRates = *rates;
+    portEXIT_CRITICAL(&scanRatesLock);
+}
+
+void sensorsWakeScanner() {
+    if (scannerTaskHandle) {
+        xTaskNotifyGive(scannerTaskHandle);
+    }
+}
+
+void sensorsSetHumanTurn(bool isHumanTurn) {
+    bool wake = isHumanTurn && !humanTurn;
+    humanTurn = isHumanTurn;
+    if (wake) {
+        sensorsWakeScanner();
+    }
+}
+
+uint64_t sensorsGetBoard() {
+    return scannedBoard;
+}
@@ -0,0 +1,158 @@
+#ifndef ESP32_BOARDCODE_SENSORS_H
+#define ESP32_BOARDCODE_SENSORS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "driver/gpio.h"
+
+#define MUX_RST GPIO_NUM_8
+#define MUX_CLK GPIO_NUM_18
+#define SENSOR_ARRAY GPIO_NUM_17
+
+// Half period of the mux clock, long enough for the scan timer interrupt to keep up
+#define SENSOR_CLOCK_HALF_PERIOD_US 5
+// Settle time after every clock edge until sensorsCalibrate() has run
+#define SENSOR_DEFAULT_SETTLE_US 20
+// Slow reference used while calibrating, well above anything the hall sensors need
+#define SENSOR_MAX_SETTLE_US 1000
+
+// Upper bound on the passes of one read, with the default timing a full pass takes about 1.6 ms
+#define SENSOR_MAX_SAMPLES 8
+
+// Default scan periods, see ScanRates
+#define SCANNER_ACTIVE_PERIOD_MS 20
+#define SCANNER_IDLE_PERIOD_MS 500
+#define SCANNER_MOTION_PERIOD_MS 1000
+#define SCANNER_ACTIVE_HOLD_MS 3000
+#define SCANNER_TASK_CORE 0
+#define SCANNER_TASK_PRIORITY 5
+#define SCANNER_TASK_STACK_SIZE 3072
+
+/*
+ * Called from the scanner task whenever the board differs from the last read, with a bit set in
+ * changed for every square that was lifted or placed. Squares that read noisily keep their last
+ * value until a later read settles them, the others take the debounced value. The first read is
+ * published with every occupied square marked changed. Must not block for long.
+ */
+typedef void (*BoardChangedCallback)(uint64_t board, uint64_t changed);
+
+/*
+ * Called from the scanner task when the piece on the magnet went astray during a move: squares has
+ * the square it was dropped on, or the square it was never lifted from. The move is stopped first.
+ */
+typedef void (*CarryLostCallback)(uint64_t squares);
+
+// A square counts as noisy once this share of its reads, in per mille, had disagreeing samples
+#define SENSOR_NOISY_PER_MILLE 10
+// Reads a square needs before it can count as noisy
+#define SENSOR_NOISY_MIN_READS 100
+
+typedef struct {
+    uint32_t reads;          // Reads that covered the square
+    uint32_t disagreements;  // Reads in which its samples did not all agree
+    uint32_t flips;          // Times the scanner saw its value change
+    uint32_t stableMs;       // How long the scanner has seen its current value
+} SquareStats;
+
+/*
+ * How often the scanner reads the board. The active period bounds how quickly a human move is
+ * seen, the idle period sets what the scanner costs between turns.
+ */
+typedef struct {
+    uint32_t activeMs;      // During the human's turn and while pieces are being moved
+    uint32_t idleMs;        // Otherwise
+    uint32_t motionMs;      // While the motors are running without a piece on the magnet
+    uint32_t activeHoldMs;  // How long a change on the board keeps the scanner active
+} ScanRates;
+
+typedef enum {
+    DEBOUNCE_MAJORITY,  // A square takes the value most of its samples had
+    DEBOUNCE_STABLE,    // A square takes the value its last stableSamples samples agreed on
+} DebounceRule;
+
+typedef struct {
+    DebounceRule rule;
+    uint8_t samples;        // Passes per read, 1 to SENSOR_MAX_SAMPLES
+    uint8_t stableSamples;  // DEBOUNCE_STABLE only, 1 to samples
+} DebounceConfig;
+
+/*
+ * Configure the mux outputs, the sensor input and the timer that clocks the mux, and load the
+ * sensor map from NVS. NVS must be initialised by then.
+ */
+void setupSensors();
+
+/*
+ * Read the whole board, one bit per square with a1 in bit 0 and h8 in bit 63. Every square is
+ * sampled in a fixed number of passes and debounced by the configured rule, so a read always takes
+ * the same time however noisy the sensors are. Squares whose samples did not all settle on the
+ * returned value are left out of the confidence mask, which may be NULL. The mux is clocked and
+ * sampled from a hardware timer interrupt while the calling task sleeps.
+ */
+uint64_t readSensors(uint64_t *confident);
+
+/*
+ * Read only the squares set in mask, debounced like readSensors(). The mux is only clocked as far
+ * as the last of them in its wiring order, so checking the two squares of a move usually takes a
+ * fraction of a full read. Squares outside mask are returned clear and not confident.
+ */
+uint64_t readSquares(uint64_t mask, uint64_t *confident);
+
+/*
+ * Change how reads are debounced. Returns false, leaving the rule as it was, for an invalid config.
+ */
+bool sensorsSetDebounce(const DebounceConfig *config);
+
+/*
+ * Set which square (a1 = 0) sits behind every mux output in clock order, and the squares whose
+ * sensor reads low when empty. Both are stored in NVS and used from then on, also after a restart,
+ * so another board revision only needs a new map. Returns false if map is not a permutation.
+ */
+bool sensorsSetMap(const uint8_t map[64], uint64_t inverted);
+
+/*
+ * Time waited after every mux clock edge before the output is sampled.
+ */
+void sensorsSetSettleTime(uint32_t settleUs);
+uint32_t sensorsGetSettleTime();
+
+/*
+ * Look for the shortest settle time at which fast reads still match a slow reference read, and use
+ * twice that from now on. The board must not be touched meanwhile, and it only tells something with
+ * pieces on it, an empty board keeps the settle time. Runs at boot and on POST /sensors/calibrate.
+ * Returns the settle time in use afterwards.
+ */
+uint32_t sensorsCalibrate();
+
+/*
+ * Health of every square, a1 first, since boot or the last reset.
+ */
+void sensorsGetStats(SquareStats stats[64]);
+void sensorsResetStats();
+
+/*
+ * Start reading the board in the background and report the changes. While the motors carry a
+ * piece, the scanner instead reads the squares along the move at the active rate to check that the
+ * piece stays on the magnet.
+ */
+void startBoardScanner(BoardChangedCallback onChanged, CarryLostCallback onCarryLost);
+
+void sensorsSetScanRates(const ScanRates *rates);
+
+/*
+ * Read the board right away instead of at the end of the current period. Safe to call from any task.
+ */
+void sensorsWakeScanner();
+
+/*
+ * Tell the scanner whose turn it is, it reads at the active rate throughout the human's turn.
+ */
+void sensorsSetHumanTurn(bool humanTurn);
+
+/*
+ * Last board read by the scanner, 0 before its first read.
+ */
+uint64_t sensorsGetBoard();
+
+#endif //ESP32_BOARDCODE_SENSORS_H
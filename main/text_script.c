@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "text_script.h"
+
+void textScriptInit(TextScriptTokenizer *tokenizer, TextCommandCallback onCommand, void *ctx) {
+    tokenizer->length = 0;
+    tokenizer->overflow = false;
+    tokenizer->onCommand = onCommand;
+    tokenizer->ctx = ctx;
+}
+
+static void endCommand(TextScriptTokenizer *tokenizer) {
+    if (tokenizer->overflow) {
+        printf("Dropped a command longer than %d bytes\n", TEXT_COMMAND_MAX_LENGTH);
+        tokenizer->onCommand(NULL, tokenizer->ctx);
+    } else if (tokenizer->length > 0) {
+        // Empty commands are skipped, as strtok used to
+        tokenizer->command[tokenizer->length] = '\0';
+        tokenizer->onCommand(tokenizer->command, tokenizer->ctx);
+    }
+    tokenizer->length = 0;
+    tokenizer->overflow = false;
+}
+
+void textScriptFeed(TextScriptTokenizer *tokenizer, const char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        // A NUL from a client that sent the terminator along ends the command like a comma
+        if (data[i] == ',' || data[i] == '\0') {
+            endCommand(tokenizer);
+        } else if (tokenizer->length < TEXT_COMMAND_MAX_LENGTH) {
+            tokenizer->command[tokenizer->length++] = data[i];
+        } else {
+            tokenizer->overflow = true;
+        }
+    }
+}
+
+void textScriptFinish(TextScriptTokenizer *tokenizer) {
+    endCommand(tokenizer);
+}
+
+static Direction extractDirection(const char *moveCommand) {
+    if (strncmp(moveCommand + 2, "NO", 2) == 0) {
+        return NO;
+    } else if (strncmp(moveCommand + 2, "SO", 2) == 0) {
+        return SO;
+    } else if (strncmp(moveCommand + 2, "WE", 2) == 0) {
+        return WE;
+    } else if (strncmp(moveCommand + 2, "EA", 2) == 0) {
+        return EA;
+    } else if (strncmp(moveCommand + 2, "NE", 2) == 0) {
+        return NE;
+    } else if (strncmp(moveCommand + 2, "NW", 2) == 0) {
+        return NW;
+    } else if (strncmp(moveCommand + 2, "SW", 2) == 0) {
+        return SW;
+    } else {
+        return SE;
+    }
+}
+
+static int extractDistance(const char *moveCommand) {
+    return atoi(moveCommand + 4);
+}
+
+/*
+ * Parse the target of a GO command, either a square ("GOe4") or tiles from the centre of a1
+ * ("GO3.5:2"). The two numbers can't be split by a comma since that separates commands.
+ */
+static bool extractTarget(const char *gotoCommand, double *xTiles, double *yTiles) {
+    const char *target = gotoCommand + 2;
+    if (target[0] >= 'a' && target[0] <= 'h' && target[1] >= '1' && target[1] <= '8') {
+        *xTiles = target[0] - 'a';
+        *yTiles = target[1] - '1';
+        return true;
+    }
+
+    char *end;
+    *xTiles = strtod(target, &end);
+    if (end == target || *end != ':') {
+        return false;
+    }
+    target = end + 1;
+    *yTiles = strtod(target, &end);
+    return end != target;
+}
+
+bool parseTextCommand(const char *command, ScriptCommand *parsed) {
+    *parsed = (ScriptCommand) {0};
+    if (strncmp(command, "MV", 2) == 0) {
+        // eg. "MVNE7"
+        parsed->type = SCRIPT_MOVE;
+        parsed->dir = extractDirection(command);
+        parsed->numHalfTiles = extractDistance(command);
+    } else if (strncmp(command, "HM", 2) == 0) {
+        // eg. "HM"
+        parsed->type = SCRIPT_HOME;
+    } else if (strncmp(command, "MG", 2) == 0) {
+        // eg. "MG1"
+        if (command[2] == '1' || command[2] == '0') {
+            parsed->type = SCRIPT_MAGNET;
+            parsed->magnetOn = command[2] == '1';
+        } else {
+            printf("wrong command in magnet toggle");
+            return false;
+        }
+    } else if (strncmp(command, "GO", 2) == 0) {
+        // eg. "GOe4" or "GO3.5:2"
+        parsed->type = SCRIPT_GOTO;
+        if (!extractTarget(command, &parsed->xTiles, &parsed->yTiles)) {
+            printf("wrong target in goto");
+            return false;
+        }
+    }else if(strncmp(command, "TM", 2) == 0){
+        // eg. TM[R/L][32byte time]
+        parsed->type = SCRIPT_CLOCK;
+        strncpy(parsed->clock, command + 2, EXECUTOR_CLOCK_LENGTH);
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef ESP32_BOARDCODE_TEXT_SCRIPT_H
+#define ESP32_BOARDCODE_TEXT_SCRIPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "executor.h"
+
+// Longest single command, a TM command with its 32 byte clock message fits with room to spare
+#define TEXT_COMMAND_MAX_LENGTH 47
+
+/*
+ * Called with each complete command, null terminated and without its delimiter. A command dropped
+ * for being longer than TEXT_COMMAND_MAX_LENGTH is passed as NULL, to be reported as failed.
+ */
+typedef void (*TextCommandCallback)(char *command, void *ctx);
+
+/*
+ * Source of script bytes for executeTextScriptStream(). Fills up to size bytes of buffer and returns
+ * how many, 0 at the end of the script or a negative value if the transport failed.
+ */
+typedef int (*TextScriptReader)(char *buffer, size_t size, void *ctx);
+
+/*
+ * Splits a comma separated script into commands as its bytes arrive, in chunks of any size. Holds
+ * at most one command, so nothing is allocated no matter how long the script is. A command longer
+ * than TEXT_COMMAND_MAX_LENGTH is dropped up to the next delimiter. Empty commands are skipped.
+ */
+typedef struct {
+    char command[TEXT_COMMAND_MAX_LENGTH + 1];
+    size_t length;
+    bool overflow;
+    TextCommandCallback onCommand;
+    void *ctx;
+} TextScriptTokenizer;
+
+void textScriptInit(TextScriptTokenizer *tokenizer, TextCommandCallback onCommand, void *ctx);
+
+/*
+ * Consume the next chunk of the script. Every command whose delimiter is in the chunk is passed to
+ * the callback before this returns.
+ */
+void textScriptFeed(TextScriptTokenizer *tokenizer, const char *data, size_t length);
+
+/*
+ * End of the script, passes on the last command if it had no trailing delimiter.
+ */
+void textScriptFinish(TextScriptTokenizer *tokenizer);
+
+/*
+ * Parse one text command for the executor. Returns false, after saying why, if it isn't one.
+ */
+bool parseTextCommand(const char *command, ScriptCommand *parsed);
+
+#endif //ESP32_BOARDCODE_TEXT_SCRIPT_H